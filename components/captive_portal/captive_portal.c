@@ -14,6 +14,26 @@ static const char *TAG = "CAPTIVE";
 
 static httpd_handle_t http_server = NULL;
 
+#define ETAG_HDR_MAX_LEN 64
+#define ACCEPT_HDR_MAX_LEN 128
+#define PORTAL_URL "http://192.168.4.1/"
+#define SCAN_ENTRY_JSON_MAX_LEN 256
+
+// Connectivity-check paths used by Android, iOS/macOS, Windows and Firefox.
+// Kept sorted for bsearch(); a redirect on any of them makes the OS open the portal.
+static const char *const probe_paths[] = {
+    "/canonical.html",
+    "/connecttest.txt",
+    "/gen_204",
+    "/generate_204",
+    "/hotspot-detect.html",
+    "/library/test/success.html",
+    "/mobile/status.php",
+    "/ncsi.txt",
+    "/redirect",
+    "/success.txt",
+};
+
 bool captive_portal_is_running(void)
 {
     return http_server != NULL;
@@ -53,43 +73,155 @@ static void url_decode_inplace(char *str)
     *write_ptr = '\0';
 }
 
+// Copies the url-decoded value of field `name` from an x-www-form-urlencoded body
+static bool form_get_field(const char *buf, const char *name, char *out, size_t out_len)
+{
+    size_t name_len = strlen(name);
+    const char *ptr = buf;
+
+    out[0] = 0;
+    while ((ptr = strstr(ptr, name)) != NULL)
+    {
+        if ((ptr == buf || ptr[-1] == '&') && ptr[name_len] == '=')
+            break;
+        ptr += name_len;
+    }
+    if (!ptr)
+        return false;
+
+    ptr += name_len + 1;
+    size_t i = 0;
+    while (*ptr && *ptr != '&' && i + 1 < out_len)
+        out[i++] = *ptr++;
+    out[i] = 0;
+    url_decode_inplace(out);
+    return true;
+}
+
 static void parse_form_urlencoded(char *buf, char *out_ssid, size_t ssid_len, char *out_pass, size_t pass_len)
 {
-    out_ssid[0] = 0;
-    out_pass[0] = 0;
-    char *ssid_ptr = strstr(buf, "ssid=");
-    if (ssid_ptr)
+    form_get_field(buf, "ssid", out_ssid, ssid_len);
+    if (!form_get_field(buf, "pass", out_pass, pass_len))
+        form_get_field(buf, "password", out_pass, pass_len);
+}
+
+static bool etag_matches(httpd_req_t *req, const html_asset_t *asset)
+{
+    char if_none_match[ETAG_HDR_MAX_LEN];
+    if (httpd_req_get_hdr_value_str(req, "If-None-Match", if_none_match, sizeof(if_none_match)) != ESP_OK)
+        return false;
+    return strstr(if_none_match, asset->etag) != NULL || strcmp(if_none_match, "*") == 0;
+}
+
+static esp_err_t send_asset(httpd_req_t *req, HtmlAsset_t id)
+{
+    const html_asset_t *asset = html_pages_get(id);
+
+    httpd_resp_set_hdr(req, "ETag", asset->etag);
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+    if (req->method == HTTP_GET && etag_matches(req, asset))
     {
-        ssid_ptr += 5;
-        size_t i = 0;
-        while (*ssid_ptr && *ssid_ptr != '&' && i + 1 < ssid_len)
-            out_ssid[i++] = *ssid_ptr++;
-        out_ssid[i] = 0;
-        url_decode_inplace(out_ssid);
+        httpd_resp_set_status(req, "304 Not Modified");
+        return httpd_resp_send(req, NULL, 0);
     }
 
-    char *pass_ptr = strstr(buf, "pass=");
-    if (!pass_ptr)
-        pass_ptr = strstr(buf, "password=");
-    if (pass_ptr)
+    httpd_resp_set_type(req, asset->content_type);
+    httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
+    return httpd_resp_send(req, (const char *)asset->gz_start, asset->gz_end - asset->gz_start);
+}
+
+static esp_err_t root_get_handler(httpd_req_t *req)
+{
+    return send_asset(req, HTML_ASSET_FORM);
+}
+
+static esp_err_t asset_get_handler(httpd_req_t *req)
+{
+    return send_asset(req, (HtmlAsset_t)(uintptr_t)req->user_ctx);
+}
+
+// Escapes an SSID for use inside a JSON string, out must hold 6 bytes per input byte + 1
+static void json_escape_ssid(const char *ssid, char *out, size_t out_len)
+{
+    size_t len = 0;
+    for (; *ssid && len + 7 <= out_len; ssid++)
     {
-        if (strncmp(pass_ptr, "password=", 9) == 0)
-            pass_ptr += 9;
+        unsigned char c = (unsigned char)*ssid;
+        if (c == '"' || c == '\\')
+        {
+            out[len++] = '\\';
+            out[len++] = c;
+        }
+        else if (c < 0x20)
+        {
+            len += snprintf(&out[len], out_len - len, "\\u%04x", c);
+        }
         else
-            pass_ptr += 5;
-        size_t i = 0;
-        while (*pass_ptr && *pass_ptr != '&' && i + 1 < pass_len)
-            out_pass[i++] = *pass_ptr++;
-        out_pass[i] = 0;
-        url_decode_inplace(out_pass);
+        {
+            out[len++] = c;
+        }
     }
+    out[len] = 0;
 }
 
-static esp_err_t root_get_handler(httpd_req_t *req)
+// Serves the cached scan results, the cache is refreshed by wifi_scan in the
+// background so this never waits for the radio
+static esp_err_t scan_get_handler(httpd_req_t *req)
 {
-    httpd_resp_set_type(req, "text/html");
-    httpd_resp_send(req, CP_HTML_FORM, HTTPD_RESP_USE_STRLEN);
-    return ESP_OK;
+    wifi_scan_entry_t entries[WIFI_SCAN_MAX_RESULTS];
+    size_t count = wifi_scan_get_results(entries, WIFI_SCAN_MAX_RESULTS);
+    if (count == 0)
+        wifi_scan_request();
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+    httpd_resp_send_chunk(req, "[", 1);
+
+    char ssid[sizeof(entries[0].ssid) * 6];
+    char item[SCAN_ENTRY_JSON_MAX_LEN];
+    for (size_t i = 0; i < count; i++)
+    {
+        json_escape_ssid(entries[i].ssid, ssid, sizeof(ssid));
+        int len = snprintf(item, sizeof(item), "%s{\"ssid\":\"%s\",\"rssi\":%d,\"auth\":%u}",
+                           i ? "," : "", ssid, entries[i].rssi, entries[i].authmode);
+        if (httpd_resp_send_chunk(req, item, len) != ESP_OK)
+            return ESP_FAIL;
+    }
+
+    httpd_resp_send_chunk(req, "]", 1);
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+static const char *provision_state_name(ProvisionState_t state)
+{
+    switch (state)
+    {
+    case PROVISION_CONNECTING:
+        return "connecting";
+    case PROVISION_CONNECTED:
+        return "connected";
+    case PROVISION_FAILED:
+        return "failed";
+    default:
+        return "idle";
+    }
+}
+
+// Lets the "connecting" page follow the credential test running on the STA side
+static esp_err_t status_get_handler(httpd_req_t *req)
+{
+    wifi_provision_status_t status;
+    wifi_get_provision_status(&status);
+
+    char ssid[sizeof(status.ssid) * 6];
+    char json[SCAN_ENTRY_JSON_MAX_LEN];
+    json_escape_ssid(status.ssid, ssid, sizeof(ssid));
+    int len = snprintf(json, sizeof(json), "{\"state\":\"%s\",\"ssid\":\"%s\",\"ip\":\"%s\"}",
+                       provision_state_name(status.state), ssid, status.ip);
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+    return httpd_resp_send(req, json, len);
 }
 
 static esp_err_t favicon_handler(httpd_req_t *req)
@@ -128,21 +260,77 @@ static esp_err_t post_connect_handler(httpd_req_t *req)
 
     wifi_credentials_t cred;
     parse_form_urlencoded(buf, cred.ssid, sizeof(cred.ssid), cred.pass, sizeof(cred.pass));
+
+    mqtt_settings_t mqtt_settings;
+    form_get_field(buf, "broker", mqtt_settings.broker_uri, sizeof(mqtt_settings.broker_uri));
+    form_get_field(buf, "topic", mqtt_settings.base_topic, sizeof(mqtt_settings.base_topic));
+    form_get_field(buf, "devid", mqtt_settings.device_id, sizeof(mqtt_settings.device_id));
     free(buf);
 
     ESP_LOGI(TAG, "Form: ssid='%s'", cred.ssid);
 
-    httpd_resp_set_type(req, "text/html");
-    httpd_resp_send(req, RESP, HTTPD_RESP_USE_STRLEN);
+    if (mqtt_config_save(&mqtt_settings) != ESP_OK)
+    {
+        ESP_LOGW(TAG, "Failed to save MQTT settings");
+    }
+
+    send_asset(req, HTML_ASSET_CONNECTING);
 
     change_wifi_mode(STA_MODE, &cred);
 
     return ESP_OK;
 }
 
+static int probe_path_cmp(const void *key, const void *elem)
+{
+    return strcmp((const char *)key, *(const char *const *)elem);
+}
+
+static bool is_probe_path(const char *uri)
+{
+    char path[32];
+    size_t len = strcspn(uri, "?");
+    if (len >= sizeof(path))
+        return false;
+
+    memcpy(path, uri, len);
+    path[len] = 0;
+    return bsearch(path, probe_paths, sizeof(probe_paths) / sizeof(probe_paths[0]),
+                   sizeof(probe_paths[0]), probe_path_cmp) != NULL;
+}
+
+static bool accepts_html(httpd_req_t *req)
+{
+    char accept[ACCEPT_HDR_MAX_LEN];
+    // A header longer than the buffer comes from a browser, treat it as accepting html
+    esp_err_t err = httpd_req_get_hdr_value_str(req, "Accept", accept, sizeof(accept));
+    if (err == ESP_ERR_HTTPD_RESULT_TRUNC)
+        return true;
+    return err == ESP_OK && strstr(accept, "text/html") != NULL;
+}
+
+static esp_err_t send_portal_redirect(httpd_req_t *req)
+{
+    httpd_resp_set_status(req, "302 Found");
+    httpd_resp_set_hdr(req, "Location", PORTAL_URL);
+    httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+    return httpd_resp_send(req, NULL, 0);
+}
+
+// The full form is only sent on "/": OS probes and page loads elsewhere get a
+// bodyless redirect to it, background fetches of unknown resources get a 404
 static esp_err_t wildcard_get_handler(httpd_req_t *req)
 {
-    return root_get_handler(req);
+    if (is_probe_path(req->uri))
+    {
+        ESP_LOGD(TAG, "Probe %s", req->uri);
+        return send_portal_redirect(req);
+    }
+    if (accepts_html(req))
+        return send_portal_redirect(req);
+
+    httpd_resp_send_404(req);
+    return ESP_OK;
 }
 
 void captive_portal_start(void)
@@ -150,9 +338,11 @@ void captive_portal_start(void)
     if (http_server)
         return;
 
+    html_pages_init();
+
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
     config.stack_size = 8192;
-    config.max_uri_handlers = 8;
+    config.max_uri_handlers = 10;
     config.max_open_sockets = 4;
     config.server_port = 80;
     config.recv_wait_timeout = 5;
@@ -173,6 +363,18 @@ void captive_portal_start(void)
     httpd_uri_t connect_uri = {.uri = "/connect", .method = HTTP_POST, .handler = post_connect_handler, .user_ctx = NULL};
     httpd_register_uri_handler(http_server, &connect_uri);
 
+    httpd_uri_t style_uri = {.uri = html_pages_get(HTML_ASSET_STYLE)->uri, .method = HTTP_GET, .handler = asset_get_handler, .user_ctx = (void *)HTML_ASSET_STYLE};
+    httpd_register_uri_handler(http_server, &style_uri);
+
+    httpd_uri_t script_uri = {.uri = html_pages_get(HTML_ASSET_SCRIPT)->uri, .method = HTTP_GET, .handler = asset_get_handler, .user_ctx = (void *)HTML_ASSET_SCRIPT};
+    httpd_register_uri_handler(http_server, &script_uri);
+
+    httpd_uri_t scan_uri = {.uri = "/scan", .method = HTTP_GET, .handler = scan_get_handler, .user_ctx = NULL};
+    httpd_register_uri_handler(http_server, &scan_uri);
+
+    httpd_uri_t status_uri = {.uri = "/status", .method = HTTP_GET, .handler = status_get_handler, .user_ctx = NULL};
+    httpd_register_uri_handler(http_server, &status_uri);
+
     httpd_uri_t favicon_uri = {.uri = "/favicon.ico", .method = HTTP_GET, .handler = favicon_handler, .user_ctx = NULL};
     httpd_register_uri_handler(http_server, &favicon_uri);
 
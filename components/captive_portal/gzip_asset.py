@@ -0,0 +1,12 @@
+#!/usr/bin/env python
+# Compresses a captive portal asset for embedding. mtime and file name are
+# left out of the gzip header so the output (and its ETag) is reproducible.
+import gzip
+import sys
+
+src, dst = sys.argv[1], sys.argv[2]
+with open(src, 'rb') as f:
+    data = f.read()
+with open(dst, 'wb') as f:
+    with gzip.GzipFile(filename='', mode='wb', fileobj=f, compresslevel=9, mtime=0) as gz:
+        gz.write(data)
@@ -1,7 +1,27 @@
 #ifndef HTML_PAGES_H_
 #define HTML_PAGES_H_
 
-extern const char *CP_HTML_FORM;
-extern const char *RESP;
+#include <stdint.h>
+#include <stddef.h>
 
-#endif /* HTML_PAGES_H_ */
\ No newline at end of file
+typedef enum {
+    HTML_ASSET_FORM = 0,
+    HTML_ASSET_STYLE,
+    HTML_ASSET_SCRIPT,
+    HTML_ASSET_CONNECTING,
+    HTML_ASSET_COUNT
+} HtmlAsset_t;
+
+// Gzip-compressed page embedded at build time (see CMakeLists.txt)
+typedef struct {
+    const char *uri;
+    const char *content_type;
+    const uint8_t *gz_start;
+    const uint8_t *gz_end;
+    char etag[11];          // quoted 32-bit FNV-1a of the gz bytes
+} html_asset_t;
+
+void html_pages_init(void);
+const html_asset_t *html_pages_get(HtmlAsset_t id);
+
+#endif /* HTML_PAGES_H_ */
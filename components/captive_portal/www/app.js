@@ -0,0 +1,23 @@
+document.getElementById('pw-toggle').addEventListener('click', function () {
+  var p = document.getElementById('pw');
+  p.type = (p.type === 'password') ? 'text' : 'password';
+});
+
+// Fills the SSID dropdown from the device's cached scan, retrying while the
+// first background scan is still running
+function loadNetworks(retries) {
+  fetch('/scan').then(function (r) { return r.json(); }).then(function (nets) {
+    var list = document.getElementById('ssids');
+    list.innerHTML = '';
+    nets.forEach(function (n) {
+      var o = document.createElement('option');
+      o.value = n.ssid;
+      o.label = n.rssi + ' dBm' + (n.auth ? '' : ', open');
+      list.appendChild(o);
+    });
+    if (!nets.length && retries > 0)
+      setTimeout(function () { loadNetworks(retries - 1); }, 3000);
+  }).catch(function () {});
+}
+
+loadNetworks(5);
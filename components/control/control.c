@@ -10,54 +10,148 @@ typedef enum
 } ButtonState_t;
 
 typedef struct {
-    ButtonState_t prev;
-    ButtonState_t curr;
-
-    uint8_t debounced_state;
-    uint8_t raw_state;
-    TickType_t last_time_change;
-
-    uint16_t hold_ticks;
+    ButtonState_t state;
+    TickType_t pressed_at;
 } button_t;
 
+#define BUTTON_NOTIFY_EDGE      BIT0
+#define BUTTON_NOTIFY_SETTLED   BIT1
+#define BUTTON_NOTIFY_BENCH     BIT2
 
-static uint8_t led_state = 0;
-static uint8_t button_bitmask[COUNT_BUTTONS];
+static uint32_t led_state = 0;
+static uint32_t buttons_pressed = 0;
 static button_t buttons[COUNT_BUTTONS];
 
 static portMUX_TYPE led_spinlock = portMUX_INITIALIZER_UNLOCKED;
-static portMUX_TYPE blink_spinlock = portMUX_INITIALIZER_UNLOCKED;
+static portMUX_TYPE edge_spinlock = portMUX_INITIALIZER_UNLOCKED;
+
+static TaskHandle_t button_task_handle = NULL;
+static esp_timer_handle_t debounce_timer = NULL;
+static esp_timer_handle_t relay_save_timer = NULL;
+static TaskHandle_t relay_save_task_handle = NULL;
+static int64_t button_edge_time_us = 0;
 
-static volatile TickType_t blink_time = 0;
+#if LATENCY_BENCH
+static volatile uint32_t bench_click_mask = 0;
+#endif
 
 
-static void mask_init(void)
+static void button_init(void)
 {
     for (uint8_t i = 0; i < COUNT_BUTTONS; i++)
     {
-        button_bitmask[i] = (1 << i);
+        buttons[i].state = BUTTON_STATE_NONE;
+        buttons[i].pressed_at = 0;
     }
+    buttons_pressed = 0;
 }
 
-static void button_init(void)
+static void IRAM_ATTR button_isr_handler(void *arg)
+{
+    BaseType_t higher_priority_woken = pdFALSE;
+
+    if (button_task_handle == NULL)
+        return;
+
+    // 64-bit store is two words on this core, keep the task from reading half of it
+    taskENTER_CRITICAL_ISR(&edge_spinlock);
+    button_edge_time_us = esp_timer_get_time();
+    taskEXIT_CRITICAL_ISR(&edge_spinlock);
+    xTaskNotifyFromISR(button_task_handle, BUTTON_NOTIFY_EDGE, eSetBits, &higher_priority_woken);
+    portYIELD_FROM_ISR(higher_priority_woken);
+}
+
+static void debounce_timer_callback(void *arg)
 {
+    if (button_task_handle)
+        xTaskNotify(button_task_handle, BUTTON_NOTIFY_SETTLED, eSetBits);
+}
+
+static void relay_save_timer_callback(void *arg)
+{
+    // NVS writes stall flash access for milliseconds, keep them off the esp_timer task
+    xTaskNotifyGive(relay_save_task_handle);
+}
+
+static void relay_state_save(void)
+{
+    // storage_set_u32() skips the write if the state toggled back in the meantime
+    if (storage_set_u32(STORAGE_KEY_RELAY_STATE, get_led_state()) == ESP_OK)
+    {
+        storage_commit();
+        metrics_inc(METRIC_RELAY_SAVES);
+    }
+}
+
+// Below the button task, so a flash write never holds up debounce handling
+static void relay_save_task(void *pvParameter)
+{
+    while (1)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        relay_state_save();
+    }
+}
+
+// The task exists before the timer, so no save request can find it missing
+static void relay_save_init(void)
+{
+    if (xTaskCreate(relay_save_task, "relay_save_task", 3072, NULL, RELAY_SAVE_TASK_PRIORITY,
+                    &relay_save_task_handle) != pdPASS)
+    {
+        ESP_LOGE(TAG, "Could not create relay save task, relay state will not persist");
+        return;
+    }
+    metrics_watch_task(relay_save_task_handle);
+
+    const esp_timer_create_args_t timer_args = {
+        .callback = relay_save_timer_callback,
+        .name = "relay_save",
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &relay_save_timer));
+}
+
+static void relay_state_restore(void)
+{
+    uint32_t saved_state = 0;
+    if (storage_get_u32(STORAGE_KEY_RELAY_STATE, &saved_state) == ESP_OK)
+    {
+        led_state = saved_state & LED_STATE_MASK;
+        relay_output_write(led_state);
+        ESP_LOGI(TAG, "Restored relay state 0x%08" PRIx32, led_state);
+    }
+}
+
+// The first change in a window arms the timer, later ones ride along with it
+static void relay_state_schedule_save(void)
+{
+    if (relay_save_timer && !esp_timer_is_active(relay_save_timer))
+        esp_timer_start_once(relay_save_timer, RELAY_STATE_SAVE_DELAY_MS * 1000ULL);
+}
+
+static void button_isr_init(void)
+{
+    const esp_timer_create_args_t timer_args = {
+        .callback = debounce_timer_callback,
+        .name = "btn_debounce",
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &debounce_timer));
+
+    ESP_ERROR_CHECK(gpio_install_isr_service(0));
     for (uint8_t i = 0; i < COUNT_BUTTONS; i++)
     {
-        buttons[i].prev = BUTTON_STATE_NONE;
-        buttons[i].curr = BUTTON_STATE_NONE;
-        buttons[i].debounced_state = 1; 
-        buttons[i].raw_state = 1;    
-        buttons[i].last_time_change = 0;
-        buttons[i].hold_ticks = 0;
+        ESP_ERROR_CHECK(gpio_isr_handler_add(channel_pins[i].button, button_isr_handler, NULL));
     }
 }
 
 void gpio_init(void)
 {
+    gpio_num_t relay_pins[COUNT_BUTTONS];
     uint64_t output_mask = (1ULL << INDICATE_STATE_LED);
     for(uint8_t i = 0; i < COUNT_BUTTONS; i++)
     {
-        output_mask |= (1ULL << led_gpio_pins[i]);
+        relay_pins[i] = channel_pins[i].relay;
+        output_mask |= (1ULL << relay_pins[i]);
     }
     gpio_config_t io_config = {
         .pin_bit_mask = output_mask,
@@ -68,151 +162,205 @@ void gpio_init(void)
 
     gpio_config(&io_config);
 
-    gpio_set_level(INDICATE_STATE_LED, false);
-    for(uint8_t i = 0; i < COUNT_BUTTONS; i++)
-    {
-        gpio_set_level(led_gpio_pins[i], false);
-    }
+    indicator_init(INDICATE_STATE_LED);
+    relay_output_init(relay_pins, COUNT_BUTTONS);
+    relay_save_init();
+    relay_state_restore();
 
     uint64_t input_mask = 0;
     for (uint8_t i = 0; i < COUNT_BUTTONS; i++) {
-        input_mask |= (1ULL << button_gpio_pins[i]);
+        input_mask |= (1ULL << channel_pins[i].button);
     }
     
     io_config.pin_bit_mask = input_mask;
 
     io_config.mode = GPIO_MODE_INPUT;
     io_config.pull_up_en = GPIO_PULLUP_ENABLE;
+    io_config.intr_type = GPIO_INTR_ANYEDGE;
     gpio_config(&io_config);
 
-    mask_init();
     button_init();
+    button_isr_init();
 }
 
-void switch_led_state(const uint8_t command)
+uint32_t apply_led_command(const led_command_t *cmd)
 {
+    uint32_t new_state;
+    bool changed;
+
     taskENTER_CRITICAL(&led_spinlock);
 
-    led_state = command;
-    for (uint8_t i = 0; i < COUNT_BUTTONS; i++)
+    switch (cmd->op)
+    {
+    case LED_CMD_ASSIGN:
+        new_state = cmd->mask;
+        break;
+    case LED_CMD_SET:
+        new_state = led_state | cmd->mask;
+        break;
+    case LED_CMD_CLEAR:
+        new_state = led_state & ~cmd->mask;
+        break;
+    case LED_CMD_TOGGLE:
+        new_state = led_state ^ cmd->mask;
+        break;
+    default:
+        new_state = led_state;
+        break;
+    }
+    new_state &= LED_STATE_MASK;
+
+    changed = (new_state != led_state);
+    if (changed)
     {
-        gpio_set_level(led_gpio_pins[i], (command & button_bitmask[i]) ? true : false);
+        led_state = new_state;
+        relay_output_write(new_state);
     }
 
     taskEXIT_CRITICAL(&led_spinlock);
+
+    if (changed)
+        relay_state_schedule_save();
+    return new_state;
 }
 
+uint32_t get_led_state(void)
+{
+    taskENTER_CRITICAL(&led_spinlock);
+    uint32_t state = led_state;
+    taskEXIT_CRITICAL(&led_spinlock);
+    return state;
+}
 
-static bool button_read_debounced(uint8_t index)
+void switch_led_state(const uint32_t command)
 {
-    bool raw_gpio_level = gpio_get_level(button_gpio_pins[index]);
-    
-    if(buttons[index].raw_state != raw_gpio_level)
-    {
-        buttons[index].raw_state = raw_gpio_level;
-        buttons[index].last_time_change = xTaskGetTickCount();
-    }
+    led_command_t cmd = {.mask = command, .op = LED_CMD_ASSIGN};
+    apply_led_command(&cmd);
+}
+
 
-    if(buttons[index].raw_state != buttons[index].debounced_state && 
-        (xTaskGetTickCount() - buttons[index].last_time_change) > pdMS_TO_TICKS(BUTTON_DEBOUNCE_MS))
+static uint32_t button_read_pressed(void)
+{
+    uint32_t pressed = 0;
+    for (uint8_t i = 0; i < COUNT_BUTTONS; i++)
     {
-        buttons[index].debounced_state = buttons[index].raw_state;
+        // Buttons pull the input low
+        if (!gpio_get_level(channel_pins[i].button))
+            pressed |= (1UL << i);
     }
-    return buttons[index].debounced_state;
+    return pressed;
 }
 
-static void button_update_state(uint8_t index)
+static void button_handle_click(uint32_t clicked)
 {
-    uint8_t state = button_read_debounced(index) << index;
-    buttons[index].curr = (state & button_bitmask[index]) ? BUTTON_STATE_NONE : BUTTON_STATE_PRESSED;
-}
+    led_command_t cmd = {.mask = clicked, .op = LED_CMD_TOGGLE};
+    TickType_t now = xTaskGetTickCount();
 
-static void button_handle_click(uint8_t i)
-{
-    taskENTER_CRITICAL(&led_spinlock);
-    led_state ^= button_bitmask[i];
-    taskEXIT_CRITICAL(&led_spinlock);
-    buttons[i].prev = BUTTON_STATE_PRESSED;
-    switch_led_state(led_state);
-    mqtt_send_to_publish(led_state);
-    ESP_LOGI(TAG, "Button %d clicked", i);
+    for (uint32_t pending = clicked; pending; pending &= pending - 1)
+    {
+        uint8_t i = __builtin_ctz(pending);
+        buttons[i].state = BUTTON_STATE_PRESSED;
+        buttons[i].pressed_at = now;
+    }
+    uint32_t state = apply_led_command(&cmd);
+    BENCH_MARK(BENCH_STAGE_BTN_APPLIED);
+    mqtt_send_to_publish(state);
 }
 
-static void handle_reset_hold(uint8_t i)
+// Runs once the inputs have been quiet for BUTTON_DEBOUNCE_MS
+static void button_handle_settled(void)
 {
-    buttons[i].hold_ticks++;
+    uint32_t pressed = button_read_pressed();
+    uint32_t changed = pressed ^ buttons_pressed;
+    buttons_pressed = pressed;
 
-    if (buttons[i].hold_ticks >= RESET_HOLD_TICKS)
+    for (uint32_t released = changed & ~pressed; released; released &= released - 1)
     {
-        ESP_LOGI(TAG, "Reset button held 10s => AP mode");
-        change_wifi_mode(AP_MODE, NULL);
-        buttons[i].hold_ticks = 0;
-        buttons[i].prev = BUTTON_STATE_HOLD;
+        buttons[__builtin_ctz(released)].state = BUTTON_STATE_NONE;
+    }
+
+    if (changed & pressed)
+    {
+        button_handle_click(changed & pressed);
+
+        taskENTER_CRITICAL(&edge_spinlock);
+        int64_t edge_time_us = button_edge_time_us;
+        taskEXIT_CRITICAL(&edge_spinlock);
+
+        int64_t latency_us = esp_timer_get_time() - edge_time_us;
+        metrics_inc(METRIC_BUTTON_CLICKS);
+        // A button held at boot settles without any edge to measure from
+        if (edge_time_us != 0)
+            metrics_record_us(METRIC_HIST_CLICK_US, latency_us);
+        ESP_LOGI(TAG, "Buttons 0x%08" PRIx32 " clicked, %" PRId64 " us after edge", changed & pressed, latency_us);
     }
 }
 
-void vTaskButtonScan(void *pvParameter)
+static void handle_reset_hold(uint8_t i)
 {
-    while (1)
+    if (buttons[i].state == BUTTON_STATE_PRESSED &&
+        (xTaskGetTickCount() - buttons[i].pressed_at) >= pdMS_TO_TICKS(RESET_HOLD_MS))
     {
-        for (uint8_t i = 0; i < COUNT_BUTTONS; i++)
-        {
-            button_update_state(i);
-
-            if (buttons[i].curr == BUTTON_STATE_PRESSED && buttons[i].prev == BUTTON_STATE_NONE)
-            {
-                button_handle_click(i);
-            }
-            else if (buttons[i].curr == BUTTON_STATE_NONE && (buttons[i].prev == BUTTON_STATE_PRESSED || buttons[i].prev == BUTTON_STATE_HOLD))
-            {
-                buttons[i].prev = BUTTON_STATE_NONE;
-                if (i == RESET_MODE_BUTTON)
-                {
-                    buttons[i].hold_ticks = 0;
-                }
-            }
-            else if (i == RESET_MODE_BUTTON && buttons[RESET_MODE_BUTTON].curr == BUTTON_STATE_PRESSED && buttons[RESET_MODE_BUTTON].prev == BUTTON_STATE_PRESSED)
-            {
-                handle_reset_hold(i);
-            }
-        }
-        vTaskDelay(pdMS_TO_TICKS(BUTTON_SCAN_PERIOD_MS));
+        ESP_LOGI(TAG, "Reset button held 10s => AP mode");
+        change_wifi_mode(AP_MODE, NULL);
+        buttons[i].state = BUTTON_STATE_HOLD;
     }
 }
 
-void change_blink_time(TickType_t new_time_ms)
+// Sleep forever unless the reset button is down and its hold deadline is pending
+static TickType_t button_wait_ticks(void)
 {
-    taskENTER_CRITICAL(&blink_spinlock);
-    blink_time = new_time_ms;
-    taskEXIT_CRITICAL(&blink_spinlock);
+    if (buttons[RESET_MODE_BUTTON].state != BUTTON_STATE_PRESSED)
+        return portMAX_DELAY;
+
+    TickType_t held = xTaskGetTickCount() - buttons[RESET_MODE_BUTTON].pressed_at;
+    TickType_t hold = pdMS_TO_TICKS(RESET_HOLD_MS);
+    return held >= hold ? 0 : hold - held;
 }
 
-void vTaskIndicateState(void *pvParameter)
+void vTaskButtonScan(void *pvParameter)
 {
-    TickType_t local_blink = 0;
+    uint32_t notify_bits = 0;
+
+    button_task_handle = xTaskGetCurrentTaskHandle();
+    // Pick up buttons that were already held down at boot
+    button_handle_settled();
 
     while (1)
     {
-        taskENTER_CRITICAL(&blink_spinlock);
-        local_blink = blink_time;
-        taskEXIT_CRITICAL(&blink_spinlock);
+        if (xTaskNotifyWait(0, UINT32_MAX, &notify_bits, button_wait_ticks()) == pdFALSE)
+        {
+            handle_reset_hold(RESET_MODE_BUTTON);
+            continue;
+        }
 
-        if (local_blink == portMAX_DELAY)
+        if (notify_bits & BUTTON_NOTIFY_EDGE)
         {
-            gpio_set_level(INDICATE_STATE_LED, true);
-            vTaskDelay(pdMS_TO_TICKS(1000));
+            esp_timer_stop(debounce_timer);
+            esp_timer_start_once(debounce_timer, BUTTON_DEBOUNCE_MS * 1000);
         }
-        else if (local_blink == 0)
+        if (notify_bits & BUTTON_NOTIFY_SETTLED)
         {
-            gpio_set_level(INDICATE_STATE_LED, false);
-            vTaskDelay(pdMS_TO_TICKS(1000));
+            button_handle_settled();
         }
-        else
+#if LATENCY_BENCH
+        // Not counted as a click: there is no edge behind it to measure from
+        if (notify_bits & BUTTON_NOTIFY_BENCH)
         {
-            gpio_set_level(INDICATE_STATE_LED, true);
-            vTaskDelay(pdMS_TO_TICKS(local_blink));
-            gpio_set_level(INDICATE_STATE_LED, false);
-            vTaskDelay(pdMS_TO_TICKS(local_blink));
+            button_handle_click(bench_click_mask);
         }
+#endif
+        handle_reset_hold(RESET_MODE_BUTTON);
     }
-}
\ No newline at end of file
+}
+
+#if LATENCY_BENCH
+// Synthetic click: enters the button task where a settled press would, the
+// debounce delay itself is not part of the measurement
+void control_bench_click(uint32_t mask)
+{
+    bench_click_mask = mask;
+    if (button_task_handle)
+        xTaskNotify(button_task_handle, BUTTON_NOTIFY_BENCH, eSetBits);
+}
+#endif
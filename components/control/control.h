@@ -2,34 +2,51 @@
 #define CONTROL_H_
 
 #include "driver/gpio.h"
+#include "esp_timer.h"
+#include "relay_output.h"
+#include "indicator.h"
 #include "shearch_component.h"
 #include "mqtt.h"
 #include "wifi_manager.h"
+#include "storage_manager.h"
+#include "latency_bench.h"
+#include "metrics.h"
 
 #define INDICATE_STATE_LED  GPIO_NUM_7  
 #define RESET_MODE_BUTTON   GPIO_NUM_0 
 
-static const gpio_num_t led_gpio_pins[COUNT_BUTTONS] = {
-    GPIO_NUM_8,
-    GPIO_NUM_9,
-    GPIO_NUM_10
-};
+typedef struct {
+    gpio_num_t button;
+    gpio_num_t relay;
+} channel_pins_t;
 
-static const gpio_num_t button_gpio_pins[COUNT_BUTTONS] = {
-    GPIO_NUM_0,
-    GPIO_NUM_1,
-    GPIO_NUM_2
+// Channel i is bit i of the state mask; add a row and bump COUNT_BUTTONS for more gangs
+static const channel_pins_t channel_pins[] = {
+    {.button = GPIO_NUM_0, .relay = GPIO_NUM_8},
+    {.button = GPIO_NUM_1, .relay = GPIO_NUM_9},
+    {.button = GPIO_NUM_2, .relay = GPIO_NUM_10},
 };
+// A missing row would be zero-filled to GPIO0, the reset button
+_Static_assert(sizeof(channel_pins) / sizeof(channel_pins[0]) == COUNT_BUTTONS,
+               "channel_pins needs exactly COUNT_BUTTONS rows");
 
 #define BUTTON_DEBOUNCE_MS          30
-#define BUTTON_SCAN_PERIOD_MS       70
-#define RESET_HOLD_TICKS            100  // ~10s
+#define RESET_HOLD_MS               10000
+// Relay changes are written to NVS at most once per window, the last state
+// before a power loss inside the window is lost
+#define RELAY_STATE_SAVE_DELAY_MS   5000
+// Flash writes run at the lowest application priority, below vTaskButtonScan
+#define RELAY_SAVE_TASK_PRIORITY    1
 
 void gpio_init(void);
-void switch_led_state(const uint8_t command);
-void change_blink_time(TickType_t new_time_ms);
+void switch_led_state(const uint32_t command);
+uint32_t apply_led_command(const led_command_t *cmd);
+uint32_t get_led_state(void);
 void vTaskButtonScan(void *pvParameter);
-void vTaskIndicateState(void* pvParameter);
+
+#if LATENCY_BENCH
+void control_bench_click(uint32_t mask);
+#endif
 
 
 #endif /* CONTROL_H_ */
\ No newline at end of file
@@ -0,0 +1,105 @@
+#include "indicator.h"
+#include "shearch_component.h"
+#include "esp_timer.h"
+
+static const char *TAG = "INDICATOR";
+
+#define INDICATE_MAX_STEPS  4
+
+typedef struct {
+    uint8_t level;
+    uint16_t duration_ms;   // 0 holds the level until the pattern changes
+} indicate_step_t;
+
+typedef struct {
+    uint8_t count;
+    indicate_step_t steps[INDICATE_MAX_STEPS];
+} indicate_sequence_t;
+
+// Each pattern is played from the first step and repeats after the last one
+static const indicate_sequence_t patterns[INDICATE_PATTERN_COUNT] = {
+    [INDICATE_OFF]       = {1, {{0, 0}}},
+    [INDICATE_ON]        = {1, {{1, 0}}},
+    [INDICATE_AP_MODE]   = {2, {{1, 400}, {0, 400}}},
+    [INDICATE_WIFI_DOWN] = {2, {{1, 1000}, {0, 1000}}},
+    [INDICATE_MQTT_DOWN] = {4, {{1, 150}, {0, 150}, {1, 150}, {0, 1200}}},
+};
+
+static gpio_num_t indicate_pin = GPIO_NUM_NC;
+static esp_timer_handle_t indicate_timer = NULL;
+static portMUX_TYPE indicate_spinlock = portMUX_INITIALIZER_UNLOCKED;
+
+static IndicatePattern_t current_pattern = INDICATE_OFF;
+static uint8_t current_step = 0;
+
+
+static void indicator_play_step(void)
+{
+    taskENTER_CRITICAL(&indicate_spinlock);
+    const indicate_sequence_t *sequence = &patterns[current_pattern];
+    indicate_step_t step = sequence->steps[current_step];
+    current_step = (current_step + 1) % sequence->count;
+    taskEXIT_CRITICAL(&indicate_spinlock);
+
+    gpio_set_level(indicate_pin, step.level);
+    if (step.duration_ms)
+    {
+        esp_timer_start_once(indicate_timer, step.duration_ms * 1000ULL);
+    }
+}
+
+static void indicator_timer_callback(void *arg)
+{
+    indicator_play_step();
+}
+
+void indicator_init(gpio_num_t pin)
+{
+    const esp_timer_create_args_t timer_args = {
+        .callback = indicator_timer_callback,
+        .name = "indicator",
+    };
+
+    indicate_pin = pin;
+    if (esp_timer_create(&timer_args, &indicate_timer) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to create indicator timer");
+        return;
+    }
+    indicator_set_pattern(INDICATE_OFF);
+}
+
+// Compare and swap happen in one critical section, so two callers racing to
+// change the pattern cannot both see the old one and overwrite each other.
+// With from == NULL the pattern is always switched.
+static void indicator_switch_pattern(const IndicatePattern_t *from, IndicatePattern_t to)
+{
+    if (to >= INDICATE_PATTERN_COUNT || indicate_timer == NULL)
+        return;
+
+    taskENTER_CRITICAL(&indicate_spinlock);
+    bool switched = (from == NULL || current_pattern == *from);
+    if (switched)
+    {
+        current_pattern = to;
+        current_step = 0;
+    }
+    taskEXIT_CRITICAL(&indicate_spinlock);
+
+    if (switched)
+    {
+        // A step of the old pattern may still be armed; restart from step 0
+        esp_timer_stop(indicate_timer);
+        indicator_play_step();
+    }
+}
+
+void indicator_set_pattern(IndicatePattern_t pattern)
+{
+    indicator_switch_pattern(NULL, pattern);
+}
+
+void indicator_replace_pattern(IndicatePattern_t from, IndicatePattern_t to)
+{
+    indicator_switch_pattern(&from, to);
+}
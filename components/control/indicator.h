@@ -0,0 +1,21 @@
+#ifndef INDICATOR_H_
+#define INDICATOR_H_
+
+#include "driver/gpio.h"
+
+typedef enum
+{
+    INDICATE_OFF = 0,       // no connection configured
+    INDICATE_ON,            // Wi-Fi and MQTT connected
+    INDICATE_AP_MODE,       // captive portal is up
+    INDICATE_WIFI_DOWN,     // reconnecting to the access point
+    INDICATE_MQTT_DOWN,     // Wi-Fi is up, broker is not
+    INDICATE_PATTERN_COUNT
+} IndicatePattern_t;
+
+void indicator_init(gpio_num_t pin);
+void indicator_set_pattern(IndicatePattern_t pattern);
+void indicator_replace_pattern(IndicatePattern_t from, IndicatePattern_t to);
+
+
+#endif /* INDICATOR_H_ */
@@ -0,0 +1,57 @@
+#include "relay_output.h"
+#include "shearch_component.h"
+
+#include "soc/soc.h"
+#include "soc/gpio_reg.h"
+
+static const char *TAG = "RELAY_OUTPUT";
+
+// Channel state -> GPIO mask is resolved 4 channels at a time from small tables
+#define RELAY_GROUP_BITS    4
+#define RELAY_GROUP_SIZE    (1 << RELAY_GROUP_BITS)
+#define RELAY_GROUPS        ((COUNT_BUTTONS + RELAY_GROUP_BITS - 1) / RELAY_GROUP_BITS)
+
+static uint32_t group_pin_masks[RELAY_GROUPS][RELAY_GROUP_SIZE];
+static uint32_t all_pins_mask = 0;
+
+
+void relay_output_init(const gpio_num_t *pins, uint8_t count)
+{
+    if (count > COUNT_BUTTONS)
+    {
+        ESP_LOGE(TAG, "Too many relay pins: %d", count);
+        count = COUNT_BUTTONS;
+    }
+
+    all_pins_mask = 0;
+    for (uint8_t g = 0; g < RELAY_GROUPS; g++)
+    {
+        for (uint8_t bits = 0; bits < RELAY_GROUP_SIZE; bits++)
+        {
+            uint32_t mask = 0;
+            for (uint8_t j = 0; j < RELAY_GROUP_BITS; j++)
+            {
+                uint8_t channel = g * RELAY_GROUP_BITS + j;
+                if (channel < count && (bits & (1 << j)))
+                    mask |= (1UL << pins[channel]);
+            }
+            group_pin_masks[g][bits] = mask;
+            all_pins_mask |= mask;
+        }
+    }
+
+    relay_output_write(0);
+}
+
+void relay_output_write(uint32_t state)
+{
+    uint32_t set_mask = 0;
+    for (uint8_t g = 0; g < RELAY_GROUPS; g++)
+    {
+        set_mask |= group_pin_masks[g][(state >> (g * RELAY_GROUP_BITS)) & (RELAY_GROUP_SIZE - 1)];
+    }
+
+    // All channels switch together through the set/clear registers
+    REG_WRITE(GPIO_OUT_W1TS_REG, set_mask);
+    REG_WRITE(GPIO_OUT_W1TC_REG, all_pins_mask & ~set_mask);
+}
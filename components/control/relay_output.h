@@ -0,0 +1,16 @@
+#ifndef RELAY_OUTPUT_H_
+#define RELAY_OUTPUT_H_
+
+#include <stdint.h>
+#include "driver/gpio.h"
+
+/*
+ * Relay/LED output backend. control.c only talks to the outputs through these
+ * two calls, so a host build can link its own implementation instead of
+ * relay_output.c.
+ */
+void relay_output_init(const gpio_num_t *pins, uint8_t count);
+void relay_output_write(uint32_t state);
+
+
+#endif /* RELAY_OUTPUT_H_ */
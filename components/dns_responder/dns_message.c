@@ -0,0 +1,90 @@
+#include "dns_message.h"
+#include <string.h>
+#include <stdbool.h>
+
+#define DNS_TYPE_A      1
+#define DNS_TYPE_ANY    255
+#define DNS_CLASS_IN    1
+
+// TYPE A, CLASS IN, TTL 60s, RDLENGTH 4, portal address; filled once at start
+static uint8_t dns_answer_tail[DNS_ANSWER_SIZE - 2];
+
+void dns_message_init(uint32_t portal_addr)
+{
+    static const uint8_t header[] = {0x00, DNS_TYPE_A, 0x00, DNS_CLASS_IN, 0x00, 0x00, 0x00, 0x3C, 0x00, 0x04};
+
+    memcpy(dns_answer_tail, header, sizeof(header));
+    memcpy(&dns_answer_tail[sizeof(header)], &portal_addr, 4);
+}
+
+/*
+ * Every A/ANY question gets an answer pointing at the portal; other types
+ * (AAAA, HTTPS, ...) get NODATA.
+ */
+size_t dns_build_response(uint8_t *buf, size_t len, size_t cap)
+{
+    if (len < DNS_HEADER_SIZE || (buf[2] & 0x80))
+        return 0;
+
+    uint16_t qdcount = (buf[4] << 8) | buf[5];
+    uint16_t answer_names[DNS_MAX_ANSWERS];
+    uint8_t ancount = 0;
+    size_t pos = DNS_HEADER_SIZE;
+
+    for (uint16_t q = 0; q < qdcount; q++)
+    {
+        size_t name = pos;
+        while (1)
+        {
+            if (pos >= len)
+                return 0;
+            uint8_t label = buf[pos];
+            if (label == 0)
+            {
+                pos++;
+                break;
+            }
+            if ((label & 0xC0) == 0xC0)
+            {
+                pos += 2;
+                break;
+            }
+            if (label & 0xC0)
+                return 0;
+            pos += label + 1;
+        }
+        if (pos + 4 > len)
+            return 0;
+
+        uint16_t qtype = (buf[pos] << 8) | buf[pos + 1];
+        uint16_t qclass = (buf[pos + 2] << 8) | buf[pos + 3];
+        pos += 4;
+
+        if ((qtype == DNS_TYPE_A || qtype == DNS_TYPE_ANY) && qclass == DNS_CLASS_IN && ancount < DNS_MAX_ANSWERS)
+        {
+            answer_names[ancount++] = name;
+        }
+    }
+
+    // Anything after the questions (EDNS OPT and such) is dropped
+    while (ancount && pos + ancount * DNS_ANSWER_SIZE > cap)
+        ancount--;
+
+    bool standard_query = (buf[2] & 0x78) == 0;
+    buf[2] = 0x84 | (buf[2] & 0x79);                // QR, AA, keep opcode and RD
+    buf[3] = 0x80 | (standard_query ? 0x00 : 0x04); // RA, NOERROR or NOTIMP
+    if (!standard_query)
+        ancount = 0;
+    buf[6] = 0x00;
+    buf[7] = ancount;
+    memset(&buf[8], 0, 4);                          // NSCOUNT, ARCOUNT
+
+    for (uint8_t i = 0; i < ancount; i++)
+    {
+        buf[pos++] = 0xC0 | (answer_names[i] >> 8);
+        buf[pos++] = answer_names[i] & 0xFF;
+        memcpy(&buf[pos], dns_answer_tail, sizeof(dns_answer_tail));
+        pos += sizeof(dns_answer_tail);
+    }
+    return pos;
+}
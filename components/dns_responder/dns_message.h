@@ -0,0 +1,21 @@
+#ifndef DNS_MESSAGE_H_
+#define DNS_MESSAGE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define DNS_HEADER_SIZE 12
+#define DNS_ANSWER_SIZE 16  // name pointer + TYPE, CLASS, TTL, RDLENGTH, address
+#define DNS_MAX_ANSWERS 4
+
+// Sets the address every A/ANY answer points at, in network byte order
+void dns_message_init(uint32_t portal_addr);
+
+/*
+ * Turns the query in buf into a response in place and returns its length,
+ * or 0 if the packet should be dropped. `len` is the query length and `cap`
+ * the size of buf; answers that do not fit in `cap` are left out.
+ */
+size_t dns_build_response(uint8_t *buf, size_t len, size_t cap);
+
+#endif /* DNS_MESSAGE_H_ */
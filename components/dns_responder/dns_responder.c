@@ -1,19 +1,33 @@
 #include "dns_responder.h"
+#include "dns_message.h"
 #include "shearch_component.h"
+#include "metrics.h"
 
 #include "lwip/sockets.h"
 #include "lwip/ip4_addr.h"
+#include "freertos/semphr.h"
 
 
-#define DNS_HEADER_SIZE 12
 #define DNS_PORT 53
+#define DNS_BUF_SIZE 512
+
+#define DNS_STOP_TIMEOUT_MS 1000
 
 #define CAPTIVE_PORTAL_IP "192.168.4.1" 
 
 static const char *TAG = "DNS_RESPONDER";
 
+// dns_task_handle and dns_task_exiting decide who closes the sockets when a
+// stop times out, both only change under dns_spinlock
 static TaskHandle_t dns_task_handle = NULL;
-static volatile bool dns_task_running = false;
+static bool dns_task_exiting = false;
+static SemaphoreHandle_t dns_stopped_sem = NULL;
+static portMUX_TYPE dns_spinlock = portMUX_INITIALIZER_UNLOCKED;
+
+static int dns_sock = -1;
+// Loopback socket used only to wake dns_task out of select() on stop
+static int dns_ctrl_sock = -1;
+static struct sockaddr_in dns_ctrl_addr;
 
 void dns_task(void *pvParameter);
 
@@ -22,6 +36,54 @@ bool dns_responder_is_running(void)
     return dns_task_handle != NULL;
 }
 
+static void dns_close_sockets(void)
+{
+    if (dns_sock >= 0)
+    {
+        close(dns_sock);
+        dns_sock = -1;
+    }
+    if (dns_ctrl_sock >= 0)
+    {
+        close(dns_ctrl_sock);
+        dns_ctrl_sock = -1;
+    }
+}
+
+static bool dns_open_sockets(void)
+{
+    struct sockaddr_in addr;
+    bzero(&addr, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = INADDR_ANY;
+    addr.sin_port = htons(DNS_PORT);
+
+    dns_sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (dns_sock < 0 || bind(dns_sock, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        ESP_LOGE(TAG, "DNS socket create/bind failed");
+        dns_close_sockets();
+        return false;
+    }
+
+    socklen_t ctrl_len = sizeof(dns_ctrl_addr);
+    bzero(&dns_ctrl_addr, sizeof(dns_ctrl_addr));
+    dns_ctrl_addr.sin_family = AF_INET;
+    dns_ctrl_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    dns_ctrl_addr.sin_port = 0;
+
+    dns_ctrl_sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (dns_ctrl_sock < 0 ||
+        bind(dns_ctrl_sock, (struct sockaddr *)&dns_ctrl_addr, sizeof(dns_ctrl_addr)) < 0 ||
+        getsockname(dns_ctrl_sock, (struct sockaddr *)&dns_ctrl_addr, &ctrl_len) < 0)
+    {
+        ESP_LOGE(TAG, "DNS control socket create/bind failed");
+        dns_close_sockets();
+        return false;
+    }
+    return true;
+}
+
 void dns_responder_start(void)
 {
     if(dns_task_handle)
@@ -29,18 +91,29 @@ void dns_responder_start(void)
         ESP_LOGW(TAG, "DNS responder already running");
         return;
     }
-    if(dns_task_running)
+    if (dns_stopped_sem == NULL)
+    {
+        dns_stopped_sem = xSemaphoreCreateBinary();
+        if (dns_stopped_sem == NULL)
+        {
+            ESP_LOGE(TAG, "Could not create DNS stop semaphore");
+            return;
+        }
+    }
+    // A task that left on a select() error gave the semaphore with nobody
+    // waiting; that give must not satisfy the next stop
+    xSemaphoreTake(dns_stopped_sem, 0);
+    if (!dns_open_sockets())
     {
-        ESP_LOGW(TAG, "DNS task is already starting");
         return;
     }
-    dns_task_running = true;
     ESP_LOGI(TAG, "Starting DNS task...");
     
     if(xTaskCreate(dns_task, "dns_task", 4096, NULL, 5, &dns_task_handle)!= pdPASS)
     {
         ESP_LOGE(TAG, "Could not create DNS task");
         dns_task_handle = NULL;
+        dns_close_sockets();
     }
 }
 
@@ -49,100 +122,99 @@ void dns_responder_stop(void)
     if (dns_task_handle)
     {
         ESP_LOGI(TAG, "Stopping DNS task...");
-        dns_task_running = false;
 
-        while (dns_task_handle != NULL)
+        const uint8_t wakeup = 0;
+        sendto(dns_ctrl_sock, &wakeup, sizeof(wakeup), 0, (struct sockaddr *)&dns_ctrl_addr, sizeof(dns_ctrl_addr));
+
+        if (xSemaphoreTake(dns_stopped_sem, pdMS_TO_TICKS(DNS_STOP_TIMEOUT_MS)) != pdTRUE)
         {
-            vTaskDelay(pdMS_TO_TICKS(100));
+            taskENTER_CRITICAL(&dns_spinlock);
+            TaskHandle_t stuck = dns_task_exiting ? NULL : dns_task_handle;
+            if (stuck)
+                dns_task_handle = NULL;
+            taskEXIT_CRITICAL(&dns_spinlock);
+
+            if (stuck)
+            {
+                // Take the task down so a later start is not refused and the
+                // port is freed; the sockets are only closed once it is gone
+                ESP_LOGE(TAG, "DNS task did not stop in time, deleting it");
+                vTaskDelete(stuck);
+                dns_close_sockets();
+            }
+            else
+            {
+                // It is already closing the sockets itself, let it finish
+                xSemaphoreTake(dns_stopped_sem, portMAX_DELAY);
+            }
         }
     }
 }
 
+static void dns_answer_init(void)
+{
+    ip4_addr_t ip_addr;
+
+    ip4addr_aton(CAPTIVE_PORTAL_IP, &ip_addr);
+    dns_message_init(ip_addr.addr);
+}
+
 void dns_task(void *pvParameter)
 {
-    int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
-    if (sock < 0)
-    {
-        ESP_LOGE(TAG, "DNS socket create failed");
-        vTaskDelete(NULL);
-        return;
-    }
+    ESP_LOGI(TAG, "DNS responder started on UDP/53");
 
-    struct sockaddr_in addr;
-    bzero(&addr, sizeof(addr));
-    addr.sin_family = AF_INET;
-    addr.sin_addr.s_addr = INADDR_ANY;
-    addr.sin_port = htons(DNS_PORT);
+    dns_answer_init();
 
-    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    // Responses are built in place, leave room for the appended answers
+    uint8_t buf[DNS_BUF_SIZE + DNS_MAX_ANSWERS * DNS_ANSWER_SIZE];
+    int max_fd = dns_sock > dns_ctrl_sock ? dns_sock : dns_ctrl_sock;
+    while (1)
     {
-        ESP_LOGE(TAG, "DNS bind failed");
-        close(sock);
-        vTaskDelete(NULL);
-        return;
-    }
+        fd_set read_fds;
+        FD_ZERO(&read_fds);
+        FD_SET(dns_sock, &read_fds);
+        FD_SET(dns_ctrl_sock, &read_fds);
 
-    struct timeval timeout;
-    timeout.tv_sec = 0;
-    timeout.tv_usec = 500000; // 500 ms
-    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
-
-    ESP_LOGI(TAG, "DNS responder started on UDP/53");
+        if (select(max_fd + 1, &read_fds, NULL, NULL, NULL) < 0)
+        {
+            ESP_LOGE(TAG, "DNS select failed");
+            break;
+        }
+        if (FD_ISSET(dns_ctrl_sock, &read_fds))
+            break;
+        if (!FD_ISSET(dns_sock, &read_fds))
+            continue;
 
-    uint8_t rxbuf[512];
-    while(dns_task_running)
-    {
         struct sockaddr_in clientAddr;
         socklen_t client_len = sizeof(clientAddr);
-        ssize_t recvLen = recvfrom(sock, rxbuf, sizeof(rxbuf), 0, (struct sockaddr *)&clientAddr, &client_len);
+        ssize_t recvLen = recvfrom(dns_sock, buf, DNS_BUF_SIZE, 0, (struct sockaddr *)&clientAddr, &client_len);
         if (recvLen < DNS_HEADER_SIZE)
             continue;
 
-        uint8_t txbuf[512];
-        memset(txbuf, 0, sizeof(txbuf));
-        txbuf[0] = rxbuf[0];
-        txbuf[1] = rxbuf[1];
-        txbuf[2] = 0x81;
-        txbuf[3] = 0x80;
-        txbuf[4] = rxbuf[4];
-        txbuf[5] = rxbuf[5];
-        txbuf[6] = 0x00;
-        txbuf[7] = 0x01;
-
-        size_t qend = DNS_HEADER_SIZE;
-        while (qend < (size_t)recvLen && rxbuf[qend] != 0)
-            qend++;
-        if (qend >= (size_t)recvLen)
-            continue;
-        qend++;
-        if (qend + 4 > (size_t)recvLen)
+        size_t txLen = dns_build_response(buf, recvLen, sizeof(buf));
+        if (txLen == 0)
             continue;
-        size_t qlen = qend + 4 - DNS_HEADER_SIZE;
-        memcpy(&txbuf[DNS_HEADER_SIZE], &rxbuf[DNS_HEADER_SIZE], qlen);
-        size_t txOffset = DNS_HEADER_SIZE + qlen;
-
-        txbuf[txOffset++] = 0xC0;
-        txbuf[txOffset++] = 0x0C;
-        txbuf[txOffset++] = 0x00; // TYPE A
-        txbuf[txOffset++] = 0x01;
-        txbuf[txOffset++] = 0x00; // CLASS IN
-        txbuf[txOffset++] = 0x01;
-        txbuf[txOffset++] = 0x00; // TTL 60s
-        txbuf[txOffset++] = 0x00;
-        txbuf[txOffset++] = 0x00;
-        txbuf[txOffset++] = 0x3C;
-        txbuf[txOffset++] = 0x00; // RDLENGTH = 4
-        txbuf[txOffset++] = 0x04;
-
-        ip4_addr_t ip_addr;
-        ip4addr_aton(CAPTIVE_PORTAL_IP, &ip_addr);
-        memcpy(&txbuf[txOffset], &ip_addr.addr, 4);
-        txOffset += 4;
-
-        sendto(sock, txbuf, txOffset, 0, (struct sockaddr *)&clientAddr, client_len);
+
+        sendto(dns_sock, buf, txLen, 0, (struct sockaddr *)&clientAddr, client_len);
+        metrics_inc(METRIC_DNS_QUERIES);
     }
-    close(sock);
+
+    taskENTER_CRITICAL(&dns_spinlock);
+    bool abandoned = (dns_task_handle == NULL);
+    dns_task_exiting = !abandoned;
+    taskEXIT_CRITICAL(&dns_spinlock);
+    if (abandoned)
+    {
+        // dns_responder_stop() timed out and owns the sockets now, it deletes us
+        vTaskSuspend(NULL);
+    }
+
+    dns_close_sockets();
+    taskENTER_CRITICAL(&dns_spinlock);
     dns_task_handle = NULL;
+    dns_task_exiting = false;
+    taskEXIT_CRITICAL(&dns_spinlock);
     ESP_LOGI(TAG, "DNS responder stopped");
+    xSemaphoreGive(dns_stopped_sem);
     vTaskDelete(NULL);
 }
@@ -0,0 +1,216 @@
+#include "latency_bench.h"
+
+#if LATENCY_BENCH
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "shearch_component.h"
+#include "esp_timer.h"
+#include "control.h"
+#include "mqtt.h"
+
+static const char *TAG = "LATENCY_BENCH";
+
+// Log-linear histogram: exact below 8 us, then 8 buckets per power of two
+// (about 12% resolution) up to ~134 s, so no samples have to be kept
+#define HIST_SUB_BITS   3
+#define HIST_SUB        (1 << HIST_SUB_BITS)
+#define HIST_OCTAVES    24
+#define HIST_BUCKETS    ((HIST_OCTAVES + 1) * HIST_SUB)
+
+typedef struct {
+    uint32_t counts[HIST_BUCKETS];
+    uint32_t total;
+    uint32_t max_us;
+} bench_hist_t;
+
+typedef struct {
+    const char *name;
+    BenchPath_t path;
+} bench_stage_info_t;
+
+static const bench_stage_info_t stage_info[BENCH_STAGE_COUNT] = {
+    [BENCH_STAGE_BTN_APPLIED]   = {"btn_applied", BENCH_PATH_BUTTON},
+    [BENCH_STAGE_PUB_DEQUEUED]  = {"pub_dequeued", BENCH_PATH_BUTTON},
+    [BENCH_STAGE_PUB_BUILT]     = {"pub_built", BENCH_PATH_BUTTON},
+    [BENCH_STAGE_PUB_SENT]      = {"pub_sent", BENCH_PATH_BUTTON},
+    [BENCH_STAGE_CMD_PARSED]    = {"cmd_parsed", BENCH_PATH_COMMAND},
+    [BENCH_STAGE_CMD_DEQUEUED]  = {"cmd_dequeued", BENCH_PATH_COMMAND},
+    [BENCH_STAGE_CMD_APPLIED]   = {"cmd_applied", BENCH_PATH_COMMAND},
+};
+
+static const BenchStage_t path_last_stage[BENCH_PATH_COUNT] = {
+    [BENCH_PATH_BUTTON]  = BENCH_STAGE_PUB_SENT,
+    [BENCH_PATH_COMMAND] = BENCH_STAGE_CMD_APPLIED,
+};
+
+static const char *const path_names[BENCH_PATH_COUNT] = {
+    [BENCH_PATH_BUTTON]  = "button -> publish",
+    [BENCH_PATH_COMMAND] = "command -> relay",
+};
+
+static bench_hist_t bench_hists[BENCH_STAGE_COUNT];
+static int64_t path_start_us[BENCH_PATH_COUNT];     // 0 while the path is idle
+static portMUX_TYPE bench_spinlock = portMUX_INITIALIZER_UNLOCKED;
+static TaskHandle_t bench_task_handle = NULL;
+
+
+static uint16_t hist_bucket(uint32_t us)
+{
+    if (us < HIST_SUB)
+        return us;
+
+    uint8_t shift = (31 - __builtin_clz(us)) - HIST_SUB_BITS;
+    uint32_t index = (shift + 1) * HIST_SUB + ((us >> shift) & (HIST_SUB - 1));
+    return index < HIST_BUCKETS ? index : HIST_BUCKETS - 1;
+}
+
+// Largest value that falls into a bucket, percentiles are reported as "<= x"
+static uint32_t hist_bucket_upper(uint16_t index)
+{
+    if (index < HIST_SUB)
+        return index;
+
+    uint8_t shift = index / HIST_SUB - 1;
+    return ((HIST_SUB + index % HIST_SUB) << shift) + (1UL << shift) - 1;
+}
+
+static uint32_t hist_percentile(const bench_hist_t *hist, uint16_t per_mille)
+{
+    uint32_t target = ((uint64_t)hist->total * per_mille + 999) / 1000;
+    uint32_t seen = 0;
+
+    for (uint16_t i = 0; i < HIST_BUCKETS; i++)
+    {
+        seen += hist->counts[i];
+        if (seen >= target && seen > 0)
+            return hist_bucket_upper(i);
+    }
+    return hist->max_us;
+}
+
+void latency_bench_start(BenchPath_t path)
+{
+    taskENTER_CRITICAL(&bench_spinlock);
+    path_start_us[path] = esp_timer_get_time();
+    taskEXIT_CRITICAL(&bench_spinlock);
+}
+
+void latency_bench_mark(BenchStage_t stage)
+{
+    int64_t now = esp_timer_get_time();
+    BenchPath_t path = stage_info[stage].path;
+    bool done = false;
+
+    taskENTER_CRITICAL(&bench_spinlock);
+    if (path_start_us[path] != 0)
+    {
+        uint32_t us = now - path_start_us[path];
+        bench_hist_t *hist = &bench_hists[stage];
+        hist->counts[hist_bucket(us)]++;
+        hist->total++;
+        if (us > hist->max_us)
+            hist->max_us = us;
+
+        if (stage == path_last_stage[path])
+        {
+            path_start_us[path] = 0;
+            done = true;
+        }
+    }
+    taskEXIT_CRITICAL(&bench_spinlock);
+
+    if (done && bench_task_handle)
+        xTaskNotifyGive(bench_task_handle);
+}
+
+static void bench_inject(BenchPath_t path)
+{
+    // Commands that change nothing (after the first "ON"): the full pipeline
+    // runs but the relays do not chatter
+    static const char command[] = "{\"state\":\"ON\"}";
+
+    if (path == BENCH_PATH_BUTTON)
+        control_bench_click(0);
+    else
+        mqtt_bench_command(command, sizeof(command) - 1, LED_STATE_MASK);
+}
+
+// Works on a copy so the bucket scans stay out of the critical section; the
+// copy is static to spare the caller's stack, only one reader at a time
+void latency_bench_stats(BenchStage_t stage, bench_stage_stats_t *out)
+{
+    static bench_hist_t hist;
+
+    taskENTER_CRITICAL(&bench_spinlock);
+    hist = bench_hists[stage];
+    taskEXIT_CRITICAL(&bench_spinlock);
+
+    out->count = hist.total;
+    out->p50_us = hist_percentile(&hist, 500);
+    out->p99_us = hist_percentile(&hist, 990);
+    out->p999_us = hist_percentile(&hist, 999);
+    out->max_us = hist.max_us;
+}
+
+static void bench_report(BenchPath_t path, uint32_t dropped)
+{
+    bench_stage_stats_t stats;
+
+    printf("\n%s: %d events, %" PRIu32 " dropped (us from start of path)\n",
+           path_names[path], LATENCY_BENCH_EVENTS, dropped);
+    printf("%-14s %8s %8s %8s %8s %8s\n", "stage", "count", "p50", "p99", "p999", "max");
+    for (uint8_t s = 0; s < BENCH_STAGE_COUNT; s++)
+    {
+        if (stage_info[s].path != path)
+            continue;
+        latency_bench_stats(s, &stats);
+        printf("%-14s %8" PRIu32 " %8" PRIu32 " %8" PRIu32 " %8" PRIu32 " %8" PRIu32 "\n",
+               stage_info[s].name, stats.count, stats.p50_us, stats.p99_us, stats.p999_us, stats.max_us);
+    }
+}
+
+static void bench_run(BenchPath_t path)
+{
+    uint32_t dropped = 0;
+
+    for (uint32_t i = 0; i < LATENCY_BENCH_EVENTS; i++)
+    {
+        ulTaskNotifyTake(pdTRUE, 0);
+        latency_bench_start(path);
+        bench_inject(path);
+
+        if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(LATENCY_BENCH_TIMEOUT_MS)) == 0)
+        {
+            taskENTER_CRITICAL(&bench_spinlock);
+            path_start_us[path] = 0;
+            taskEXIT_CRITICAL(&bench_spinlock);
+            dropped++;
+        }
+        vTaskDelay(pdMS_TO_TICKS(LATENCY_BENCH_GAP_MS));
+    }
+    bench_report(path, dropped);
+}
+
+// Runs every path once after boot and prints the tables over the console
+void vTaskLatencyBench(void *pvParameter)
+{
+    bench_task_handle = xTaskGetCurrentTaskHandle();
+    memset(bench_hists, 0, sizeof(bench_hists));
+
+    // Let Wi-Fi and MQTT settle so the publish stage measures the online path
+    vTaskDelay(pdMS_TO_TICKS(10000));
+    ESP_LOGI(TAG, "Running %d events per path", LATENCY_BENCH_EVENTS);
+
+    for (uint8_t path = 0; path < BENCH_PATH_COUNT; path++)
+    {
+        bench_run(path);
+    }
+    ESP_LOGI(TAG, "Done");
+    vTaskDelete(NULL);
+}
+
+#endif /* LATENCY_BENCH */
@@ -0,0 +1,51 @@
+#ifndef LATENCY_BENCH_H_
+#define LATENCY_BENCH_H_
+
+#include <stdint.h>
+
+#ifndef LATENCY_BENCH
+#define LATENCY_BENCH 0
+#endif
+
+#define LATENCY_BENCH_EVENTS        2000    // synthetic events per path and run
+#define LATENCY_BENCH_GAP_MS        5       // idle time between events
+#define LATENCY_BENCH_TIMEOUT_MS    1000    // an event not finished by then is dropped
+
+typedef enum {
+    BENCH_PATH_BUTTON = 0,      // click -> state published
+    BENCH_PATH_COMMAND,         // MQTT command -> relays written
+    BENCH_PATH_COUNT
+} BenchPath_t;
+
+// Stages are timed from the start of their path; the last stage of a path ends it
+typedef enum {
+    BENCH_STAGE_BTN_APPLIED = 0,    // relays written in the button task
+    BENCH_STAGE_PUB_DEQUEUED,       // state picked up by vTaskMqttPublish
+    BENCH_STAGE_PUB_BUILT,          // state JSON built
+    BENCH_STAGE_PUB_SENT,           // handed to the MQTT client (or skipped while offline)
+    BENCH_STAGE_CMD_PARSED,         // JSON parsed into a led_command_t and queued
+    BENCH_STAGE_CMD_DEQUEUED,       // command picked up by vTaskParseFromMqtt
+    BENCH_STAGE_CMD_APPLIED,        // relays written
+    BENCH_STAGE_COUNT
+} BenchStage_t;
+
+// Percentiles are bucket upper bounds, within about 12% of the sample
+typedef struct {
+    uint32_t count;
+    uint32_t p50_us;
+    uint32_t p99_us;
+    uint32_t p999_us;
+    uint32_t max_us;
+} bench_stage_stats_t;
+
+#if LATENCY_BENCH
+void latency_bench_start(BenchPath_t path);
+void latency_bench_mark(BenchStage_t stage);
+void latency_bench_stats(BenchStage_t stage, bench_stage_stats_t *out);
+void vTaskLatencyBench(void *pvParameter);
+#define BENCH_MARK(stage)   latency_bench_mark(stage)
+#else
+#define BENCH_MARK(stage)   do { } while (0)
+#endif
+
+#endif /* LATENCY_BENCH_H_ */
@@ -0,0 +1,186 @@
+#include "log_stream.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <strings.h>
+#include <inttypes.h>
+#include "freertos/ringbuf.h"
+#include "shearch_component.h"
+#include "metrics.h"
+
+static const char *TAG = "LOG_STREAM";
+
+static RingbufHandle_t log_ring = NULL;
+static vprintf_like_t uart_vprintf = NULL;
+static TaskHandle_t drain_task_handle = NULL;
+static volatile log_stream_sink_t log_sink = NULL;
+static volatile esp_log_level_t remote_level = LOG_STREAM_REMOTE_DEFAULT;
+
+static const char *const level_names[] = {
+    [ESP_LOG_NONE]    = "NONE",
+    [ESP_LOG_ERROR]   = "ERROR",
+    [ESP_LOG_WARN]    = "WARN",
+    [ESP_LOG_INFO]    = "INFO",
+    [ESP_LOG_DEBUG]   = "DEBUG",
+    [ESP_LOG_VERBOSE] = "VERBOSE",
+};
+
+// Installed as the esp_log output. Formats straight into a ring slot, so no
+// line buffer lands on the caller's stack (esp_timer task, event handlers);
+// a full ring drops the line without waiting
+static int log_stream_vprintf(const char *fmt, va_list args)
+{
+    // Lines from the drain task itself (the MQTT sink) would feed back into the
+    // ring, and a slot cannot be acquired from an ISR
+    if (log_ring == NULL || xTaskGetCurrentTaskHandle() == drain_task_handle || xPortInIsrContext())
+        return uart_vprintf(fmt, args);
+
+    // Measure first so the slot is only as large as the line
+    va_list measure;
+    va_copy(measure, args);
+    int len = vsnprintf(NULL, 0, fmt, measure);
+    va_end(measure);
+    if (len < 0)
+        return len;
+
+    bool cut = (len >= LOG_STREAM_LINE_MAX);
+    size_t size = (cut ? LOG_STREAM_LINE_MAX - 1 : (size_t)len) + 1;
+    char *slot = NULL;
+    if (xRingbufferSendAcquire(log_ring, (void **)&slot, size, 0) != pdTRUE)
+    {
+        metrics_inc(METRIC_LOG_DROPS);
+        return len;
+    }
+
+    // The slot keeps vsnprintf's terminator, the drain task stops at it
+    vsnprintf(slot, size, fmt, args);
+    if (cut)
+        slot[size - 2] = '\n';
+    xRingbufferSendComplete(log_ring, slot);
+    return len;
+}
+
+void log_stream_init(void)
+{
+    if (log_ring != NULL)
+        return;
+
+    log_ring = xRingbufferCreate(LOG_STREAM_BUF_SIZE, RINGBUF_TYPE_NOSPLIT);
+    if (log_ring == NULL)
+    {
+        ESP_LOGE(TAG, "Failed to create log ring, logging stays synchronous");
+        return;
+    }
+    uart_vprintf = esp_log_set_vprintf(log_stream_vprintf);
+}
+
+void log_stream_set_sink(log_stream_sink_t sink)
+{
+    log_sink = sink;
+}
+
+void log_stream_set_remote_level(esp_log_level_t level)
+{
+    remote_level = level;
+}
+
+// esp_log lines start with the level letter, after the color code if enabled
+static esp_log_level_t log_line_level(const char *line, size_t len)
+{
+    size_t i = 0;
+    if (len > 0 && line[0] == '\033')
+    {
+        while (i < len && line[i] != 'm')
+            i++;
+        i++;
+    }
+    if (i >= len)
+        return ESP_LOG_NONE;
+
+    switch (line[i])
+    {
+    case 'E': return ESP_LOG_ERROR;
+    case 'W': return ESP_LOG_WARN;
+    case 'I': return ESP_LOG_INFO;
+    case 'D': return ESP_LOG_DEBUG;
+    case 'V': return ESP_LOG_VERBOSE;
+    default:  return ESP_LOG_NONE;
+    }
+}
+
+static bool log_level_from_name(const char *name, size_t len, esp_log_level_t *out_level)
+{
+    for (uint8_t i = 0; i < sizeof(level_names) / sizeof(level_names[0]); i++)
+    {
+        if (strlen(level_names[i]) == len && strncasecmp(name, level_names[i], len) == 0)
+        {
+            *out_level = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+// "<tag>=<level>": "*" addresses every tag, "remote" the threshold for the sink,
+// e.g. "MQTT_SENSOR=debug" or "remote=info"
+esp_err_t log_stream_apply_setting(const char *data, size_t data_len)
+{
+    char tag[32];
+    const char *eq = memchr(data, '=', data_len);
+    esp_log_level_t level;
+
+    if (eq == NULL || eq == data || (size_t)(eq - data) >= sizeof(tag) ||
+        !log_level_from_name(eq + 1, data + data_len - eq - 1, &level))
+    {
+        ESP_LOGW(TAG, "Expected <tag>=<level>, got '%.*s'", (int)data_len, data);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    memcpy(tag, data, eq - data);
+    tag[eq - data] = '\0';
+
+    if (strcmp(tag, "remote") == 0)
+        log_stream_set_remote_level(level);
+    else
+        esp_log_level_set(tag, level);
+
+    ESP_LOGI(TAG, "Log level of %s set to %s", tag, level_names[level]);
+    return ESP_OK;
+}
+
+void vTaskLogStreamDrain(void *pvParameter)
+{
+    uint32_t reported_drops = 0;
+
+    if (log_ring == NULL)
+        vTaskDelete(NULL);
+
+    drain_task_handle = xTaskGetCurrentTaskHandle();
+    while (1)
+    {
+        size_t len = 0;
+        char *line = xRingbufferReceive(log_ring, &len, portMAX_DELAY);
+        if (line == NULL)
+            continue;
+        len = strnlen(line, len);
+
+        fwrite(line, 1, len, stdout);
+
+        log_stream_sink_t sink = log_sink;
+        esp_log_level_t level = log_line_level(line, len);
+        if (sink && level != ESP_LOG_NONE && level <= remote_level)
+        {
+            if (len > 0 && line[len - 1] == '\n')
+                len--;
+            sink(line, len);
+        }
+        vRingbufferReturnItem(log_ring, line);
+
+        uint32_t drops = metrics_get(METRIC_LOG_DROPS);
+        if (drops != reported_drops)
+        {
+            printf("... %" PRIu32 " log line(s) dropped\n", drops - reported_drops);
+            reported_drops = drops;
+        }
+    }
+}
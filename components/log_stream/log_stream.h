@@ -0,0 +1,22 @@
+#ifndef LOG_STREAM_H_
+#define LOG_STREAM_H_
+
+#include <stddef.h>
+#include "esp_err.h"
+#include "esp_log.h"
+
+#define LOG_STREAM_BUF_SIZE         4096    // RAM ring shared by all tasks
+#define LOG_STREAM_LINE_MAX         192     // longer lines are cut
+#define LOG_STREAM_REMOTE_DEFAULT   ESP_LOG_WARN
+
+// Receives each line without its trailing newline, from the drain task only
+typedef void (*log_stream_sink_t)(const char *line, size_t len);
+
+void log_stream_init(void);
+void log_stream_set_sink(log_stream_sink_t sink);
+void log_stream_set_remote_level(esp_log_level_t level);
+esp_err_t log_stream_apply_setting(const char *data, size_t data_len);
+
+void vTaskLogStreamDrain(void *pvParameter);
+
+#endif /* LOG_STREAM_H_ */
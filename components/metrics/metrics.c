@@ -0,0 +1,141 @@
+#include "metrics.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <inttypes.h>
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "shearch_component.h"
+
+static const char *TAG = "METRICS";
+
+static const char *const counter_names[METRIC_COUNTER_COUNT] = {
+    [METRIC_MQTT_CONNECTS]      = "mqtt_conn",
+    [METRIC_MQTT_DISCONNECTS]   = "mqtt_disc",
+    [METRIC_MQTT_CMDS]          = "mqtt_cmd",
+    [METRIC_MQTT_PARSE_ERRORS]  = "mqtt_parse_err",
+    [METRIC_MQTT_CMD_DROPS]     = "mqtt_cmd_drop",
+    [METRIC_MQTT_PUBLISHES]     = "mqtt_pub",
+    [METRIC_MQTT_PUBLISH_FAILS] = "mqtt_pub_fail",
+    [METRIC_WIFI_ATTEMPTS]      = "wifi_try",
+    [METRIC_WIFI_DISCONNECTS]   = "wifi_disc",
+    [METRIC_DNS_QUERIES]        = "dns_query",
+    [METRIC_BUTTON_CLICKS]      = "btn_click",
+    [METRIC_RELAY_SAVES]        = "relay_save",
+    [METRIC_LOG_DROPS]          = "log_drop",
+};
+
+static const char *const hist_names[METRIC_HIST_COUNT] = {
+    [METRIC_HIST_CLICK_US]      = "click_us",
+    [METRIC_HIST_PUBLISH_US]    = "pub_us",
+    [METRIC_HIST_NVS_COMMIT_US] = "nvs_commit_us",
+};
+
+static const uint32_t hist_bounds_us[METRICS_HIST_BUCKETS - 1] = METRICS_HIST_BOUNDS_US;
+
+static atomic_uint_least32_t counters[METRIC_COUNTER_COUNT];
+static atomic_uint_least32_t hists[METRIC_HIST_COUNT][METRICS_HIST_BUCKETS];
+
+static TaskHandle_t watched_tasks[METRICS_MAX_TASKS];
+static uint8_t watched_task_count = 0;
+
+
+void metrics_inc(MetricCounter_t counter)
+{
+    atomic_fetch_add_explicit(&counters[counter], 1, memory_order_relaxed);
+}
+
+void metrics_add(MetricCounter_t counter, uint32_t value)
+{
+    atomic_fetch_add_explicit(&counters[counter], value, memory_order_relaxed);
+}
+
+uint32_t metrics_get(MetricCounter_t counter)
+{
+    return atomic_load_explicit(&counters[counter], memory_order_relaxed);
+}
+
+void metrics_record_us(MetricHist_t hist, uint32_t us)
+{
+    uint8_t bucket = 0;
+    while (bucket < METRICS_HIST_BUCKETS - 1 && us > hist_bounds_us[bucket])
+    {
+        bucket++;
+    }
+    atomic_fetch_add_explicit(&hists[hist][bucket], 1, memory_order_relaxed);
+}
+
+void metrics_watch_task(TaskHandle_t handle)
+{
+    if (handle == NULL)
+        return;
+    if (watched_task_count >= METRICS_MAX_TASKS)
+    {
+        ESP_LOGW(TAG, "Task table full, not watching %s", pcTaskGetName(handle));
+        return;
+    }
+    watched_tasks[watched_task_count++] = handle;
+}
+
+static bool json_append(char *buf, size_t size, size_t *len, const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(&buf[*len], size - *len, fmt, args);
+    va_end(args);
+
+    if (n < 0 || (size_t)n >= size - *len)
+        return false;
+    *len += n;
+    return true;
+}
+
+// Counters and buckets are read one by one, so a report taken while they are
+// being bumped can be off by the few events that land during the walk
+esp_err_t metrics_build_json(char *json_buf, size_t buf_size, size_t *out_len)
+{
+    if (!json_buf || buf_size == 0)
+        return ESP_ERR_INVALID_ARG;
+
+    size_t len = 0;
+    bool ok = json_append(json_buf, buf_size, &len, "{\"up_s\":%" PRIu32 ",\"heap\":%" PRIu32 ",\"heap_min\":%" PRIu32,
+                          (uint32_t)(esp_timer_get_time() / 1000000), esp_get_free_heap_size(),
+                          esp_get_minimum_free_heap_size());
+
+    for (uint8_t i = 0; ok && i < METRIC_COUNTER_COUNT; i++)
+    {
+        ok = json_append(json_buf, buf_size, &len, ",\"%s\":%" PRIu32, counter_names[i],
+                         (uint32_t)atomic_load_explicit(&counters[i], memory_order_relaxed));
+    }
+
+    for (uint8_t h = 0; ok && h < METRIC_HIST_COUNT; h++)
+    {
+        ok = json_append(json_buf, buf_size, &len, ",\"%s\":[", hist_names[h]);
+        for (uint8_t b = 0; ok && b < METRICS_HIST_BUCKETS; b++)
+        {
+            ok = json_append(json_buf, buf_size, &len, b ? ",%" PRIu32 : "%" PRIu32,
+                             (uint32_t)atomic_load_explicit(&hists[h][b], memory_order_relaxed));
+        }
+        ok = ok && json_append(json_buf, buf_size, &len, "]");
+    }
+
+    // Free stack in bytes at the tightest point each task has reached so far
+    ok = ok && json_append(json_buf, buf_size, &len, ",\"stack\":{");
+    for (uint8_t i = 0; ok && i < watched_task_count; i++)
+    {
+        ok = json_append(json_buf, buf_size, &len, i ? ",\"%s\":%u" : "\"%s\":%u",
+                         pcTaskGetName(watched_tasks[i]),
+                         (unsigned)(uxTaskGetStackHighWaterMark(watched_tasks[i]) * sizeof(StackType_t)));
+    }
+    ok = ok && json_append(json_buf, buf_size, &len, "}}");
+
+    if (!ok)
+    {
+        ESP_LOGE(TAG, "JSON too long");
+        return ESP_ERR_NO_MEM;
+    }
+    if (out_len)
+        *out_len = len;
+    return ESP_OK;
+}
@@ -0,0 +1,54 @@
+#ifndef METRICS_H_
+#define METRICS_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_err.h"
+
+#define METRICS_REPORT_INTERVAL_MS  60000
+#define METRICS_MAX_TASKS           8       // tasks whose stack high-water mark is reported
+#define METRICS_JSON_MAX_LEN        1024
+
+// Counters only ever grow; the reader diffs two reports to get a rate
+typedef enum {
+    METRIC_MQTT_CONNECTS = 0,
+    METRIC_MQTT_DISCONNECTS,
+    METRIC_MQTT_CMDS,               // complete command messages received
+    METRIC_MQTT_PARSE_ERRORS,
+    METRIC_MQTT_CMD_DROPS,          // queue full, oversized or broken chunked message
+    METRIC_MQTT_PUBLISHES,
+    METRIC_MQTT_PUBLISH_FAILS,      // state publish refused: offline or client outbox full
+    METRIC_WIFI_ATTEMPTS,
+    METRIC_WIFI_DISCONNECTS,        // an established link dropped
+    METRIC_DNS_QUERIES,             // captive portal DNS answers sent
+    METRIC_BUTTON_CLICKS,
+    METRIC_RELAY_SAVES,
+    METRIC_LOG_DROPS,               // log lines lost to a full ring
+    METRIC_COUNTER_COUNT
+} MetricCounter_t;
+
+// All histograms share METRICS_HIST_BOUNDS_US; the last bucket is open-ended
+typedef enum {
+    METRIC_HIST_CLICK_US = 0,       // button edge -> relays written
+    METRIC_HIST_PUBLISH_US,         // esp_mqtt_client_publish() call that was accepted
+    METRIC_HIST_NVS_COMMIT_US,      // storage_commit() with something to write
+    METRIC_HIST_COUNT
+} MetricHist_t;
+
+#define METRICS_HIST_BOUNDS_US  {100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000}
+#define METRICS_HIST_BUCKETS    11
+
+// Safe from any task; counters are relaxed atomics, no locks are taken
+void metrics_inc(MetricCounter_t counter);
+void metrics_add(MetricCounter_t counter, uint32_t value);
+void metrics_record_us(MetricHist_t hist, uint32_t us);
+uint32_t metrics_get(MetricCounter_t counter);
+
+// Only from app_main, before the reporter runs
+void metrics_watch_task(TaskHandle_t handle);
+
+esp_err_t metrics_build_json(char *json_buf, size_t buf_size, size_t *out_len);
+
+#endif /* METRICS_H_ */
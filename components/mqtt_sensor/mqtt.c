@@ -1,16 +1,279 @@
 #include "mqtt.h"
 #include "parse.h"
 #include "control.h"
+#include "storage_manager.h"
+#include "metrics.h"
+#include "log_stream.h"
 #include "shearch_component.h"
+#include "esp_timer.h"
+#include "freertos/semphr.h"
+#include <stdlib.h>
+#include <inttypes.h>
 
 static const char *TAG = "MQTT_SENSOR";
 
+
 static esp_mqtt_client_handle_t client = NULL;
 
 static QueueHandle_t xMqttSubQueue = NULL;
 static QueueHandle_t xMqttPubQueue = NULL;
 
 static volatile bool mqtt_connected = false;
+// Held around every use of `client` outside its own event handler, so
+// mqtt_app_stop() cannot destroy it under a publisher
+static SemaphoreHandle_t client_lock = NULL;
+static bool mqtt_first_connect_logged = false;
+
+typedef struct {
+    mqtt_settings_t settings;
+
+    char topic_sub[MQTT_TOPIC_MAX_LEN];
+    char topic_pub[MQTT_TOPIC_MAX_LEN];
+    char topic_avail[MQTT_TOPIC_MAX_LEN];
+    char topic_metrics[MQTT_TOPIC_MAX_LEN];
+    char topic_log[MQTT_TOPIC_MAX_LEN];
+    char topic_log_level[MQTT_TOPIC_MAX_LEN];
+    char topic_ch_sub[MQTT_TOPIC_MAX_LEN];
+    char topic_ch_prefix[MQTT_TOPIC_MAX_LEN];
+
+    size_t topic_sub_len;
+    size_t topic_log_level_len;
+    size_t topic_ch_prefix_len;
+} mqtt_config_t;
+
+static mqtt_config_t mqtt_config;
+
+// Reassembly of a command delivered in several MQTT_EVENT_DATA events. The
+// client delivers the chunks of one message back to back from its own task,
+// so a single buffer is enough; it is only taken for fragmented messages.
+typedef struct {
+    char *buf;
+    size_t total_len;
+    size_t received;
+    uint32_t target_mask;
+    bool active;
+} mqtt_reasm_t;
+
+static mqtt_reasm_t mqtt_reasm;
+
+static void mqtt_config_build_topics(void)
+{
+    const mqtt_settings_t *settings = &mqtt_config.settings;
+
+    snprintf(mqtt_config.topic_sub, MQTT_TOPIC_MAX_LEN, "%s/%s" MQTT_TOPIC_SUB_SUFFIX,
+             settings->base_topic, settings->device_id);
+    snprintf(mqtt_config.topic_pub, MQTT_TOPIC_MAX_LEN, "%s/%s" MQTT_TOPIC_PUB_SUFFIX,
+             settings->base_topic, settings->device_id);
+    snprintf(mqtt_config.topic_avail, MQTT_TOPIC_MAX_LEN, "%s/%s" MQTT_TOPIC_AVAIL_SUFFIX,
+             settings->base_topic, settings->device_id);
+    snprintf(mqtt_config.topic_metrics, MQTT_TOPIC_MAX_LEN, "%s/%s" MQTT_TOPIC_METRICS_SUFFIX,
+             settings->base_topic, settings->device_id);
+    snprintf(mqtt_config.topic_log, MQTT_TOPIC_MAX_LEN, "%s/%s" MQTT_TOPIC_LOG_SUFFIX,
+             settings->base_topic, settings->device_id);
+    snprintf(mqtt_config.topic_log_level, MQTT_TOPIC_MAX_LEN, "%s/%s" MQTT_TOPIC_LOG_LEVEL_SUFFIX,
+             settings->base_topic, settings->device_id);
+    snprintf(mqtt_config.topic_ch_prefix, MQTT_TOPIC_MAX_LEN, "%s/%s" MQTT_TOPIC_CH_INFIX,
+             settings->base_topic, settings->device_id);
+    snprintf(mqtt_config.topic_ch_sub, MQTT_TOPIC_MAX_LEN, "%s+" MQTT_TOPIC_CH_SUFFIX,
+             mqtt_config.topic_ch_prefix);
+
+    mqtt_config.topic_sub_len = strlen(mqtt_config.topic_sub);
+    mqtt_config.topic_log_level_len = strlen(mqtt_config.topic_log_level);
+    mqtt_config.topic_ch_prefix_len = strlen(mqtt_config.topic_ch_prefix);
+}
+
+static void mqtt_config_load_str(StorageKey_t key, char *value, size_t length, const char *default_value)
+{
+    if (storage_get_str(key, value, length) != ESP_OK || value[0] == '\0')
+    {
+        strlcpy(value, default_value, length);
+    }
+}
+
+void mqtt_config_load(void)
+{
+    mqtt_settings_t *settings = &mqtt_config.settings;
+
+    if (client_lock == NULL)
+    {
+        client_lock = xSemaphoreCreateMutex();
+        if (client_lock == NULL)
+            ESP_LOGE(TAG, "Failed to create MQTT client lock");
+    }
+
+    mqtt_config_load_str(STORAGE_KEY_MQTT_URI, settings->broker_uri, sizeof(settings->broker_uri), MQTT_DEFAULT_BROKER_URI);
+    mqtt_config_load_str(STORAGE_KEY_MQTT_BASE, settings->base_topic, sizeof(settings->base_topic), MQTT_DEFAULT_BASE_TOPIC);
+    mqtt_config_load_str(STORAGE_KEY_MQTT_ID, settings->device_id, sizeof(settings->device_id), MQTT_DEFAULT_DEVICE_ID);
+
+    mqtt_config_build_topics();
+    ESP_LOGI(TAG, "Broker: %s, topics: %s, %s", settings->broker_uri, mqtt_config.topic_sub, mqtt_config.topic_pub);
+}
+
+static esp_err_t mqtt_config_save_str(StorageKey_t key, const char *value)
+{
+    if (value[0] == '\0')
+        return ESP_OK;
+    // Stored empty, mqtt_config_load_str() falls back to the default
+    if (strcmp(value, MQTT_SETTING_RESET) == 0)
+        value = "";
+    return storage_set_str(key, value);
+}
+
+esp_err_t mqtt_config_save(const mqtt_settings_t *settings)
+{
+    if (!settings)
+        return ESP_ERR_INVALID_ARG;
+
+    if (mqtt_config_save_str(STORAGE_KEY_MQTT_URI, settings->broker_uri) != ESP_OK)
+        return ESP_FAIL;
+    if (mqtt_config_save_str(STORAGE_KEY_MQTT_BASE, settings->base_topic) != ESP_OK)
+        return ESP_FAIL;
+    if (mqtt_config_save_str(STORAGE_KEY_MQTT_ID, settings->device_id) != ESP_OK)
+        return ESP_FAIL;
+    if (storage_commit() != ESP_OK)
+        return ESP_FAIL;
+
+    // Takes effect on the next mqtt_app_start(), which reloads the settings;
+    // a running client keeps the broker and topics it was started with
+    return ESP_OK;
+}
+
+void mqtt_config_get(mqtt_settings_t *out_settings)
+{
+    *out_settings = mqtt_config.settings;
+}
+
+static bool mqtt_topic_to_mask(const char *topic, size_t topic_len, uint32_t *out_mask)
+{
+    const size_t prefix_len = mqtt_config.topic_ch_prefix_len;
+    const size_t suffix_len = sizeof(MQTT_TOPIC_CH_SUFFIX) - 1;
+
+    if (topic_len == mqtt_config.topic_sub_len && !memcmp(topic, mqtt_config.topic_sub, topic_len))
+    {
+        *out_mask = LED_STATE_MASK;
+        return true;
+    }
+
+    if (topic_len <= prefix_len + suffix_len ||
+        memcmp(topic, mqtt_config.topic_ch_prefix, prefix_len) ||
+        memcmp(topic + topic_len - suffix_len, MQTT_TOPIC_CH_SUFFIX, suffix_len))
+    {
+        return false;
+    }
+
+    uint32_t channel = 0;
+    for (const char *p = topic + prefix_len; p < topic + topic_len - suffix_len; p++)
+    {
+        if (*p < '0' || *p > '9')
+            return false;
+        channel = channel * 10 + (*p - '0');
+        if (channel >= COUNT_BUTTONS)
+            return false;
+    }
+    *out_mask = (1UL << channel);
+    return true;
+}
+
+// Parses in the caller's context, only the decoded command is queued
+static esp_err_t mqtt_queue_command(const char *data, size_t data_len, uint32_t target_mask, TickType_t wait)
+{
+    led_command_t cmd;
+
+    if (xMqttSubQueue == NULL)
+        return ESP_ERR_INVALID_STATE;
+
+    if (parse_mqtt_command_json(data, data_len, target_mask, &cmd) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to parse state from MQTT data");
+        metrics_inc(METRIC_MQTT_PARSE_ERRORS);
+        return ESP_FAIL;
+    }
+    BENCH_MARK(BENCH_STAGE_CMD_PARSED);
+
+    if (xQueueSend(xMqttSubQueue, &cmd, wait) != pdTRUE)
+    {
+        ESP_LOGW(TAG, "Command queue full, dropping command");
+        metrics_inc(METRIC_MQTT_CMD_DROPS);
+        return ESP_ERR_TIMEOUT;
+    }
+    return ESP_OK;
+}
+
+static void mqtt_handle_data(esp_mqtt_event_handle_t event)
+{
+    uint32_t target_mask;
+
+    // The topic is only present on the first chunk of a message
+    if (event->current_data_offset == 0)
+    {
+        mqtt_reasm.active = false;
+        ESP_LOGD(TAG, "Data on %.*s: %.*s", event->topic_len, event->topic, event->data_len, event->data);
+
+        if ((size_t)event->topic_len == mqtt_config.topic_log_level_len &&
+            !memcmp(event->topic, mqtt_config.topic_log_level, event->topic_len))
+        {
+            if (event->data_len == event->total_data_len)
+                log_stream_apply_setting(event->data, event->data_len);
+            return;
+        }
+
+        if (!mqtt_topic_to_mask(event->topic, event->topic_len, &target_mask))
+        {
+            ESP_LOGW(TAG, "Ignoring message on unknown topic");
+            return;
+        }
+
+        if (event->data_len == event->total_data_len)
+        {
+            metrics_inc(METRIC_MQTT_CMDS);
+            mqtt_queue_command(event->data, event->data_len, target_mask, pdMS_TO_TICKS(10));
+            return;
+        }
+
+        if (event->total_data_len > MQTT_CMD_REASM_MAX_LEN)
+        {
+            ESP_LOGW(TAG, "Dropping %d byte command, limit is %d", event->total_data_len, MQTT_CMD_REASM_MAX_LEN);
+            metrics_inc(METRIC_MQTT_CMD_DROPS);
+            return;
+        }
+        if (mqtt_reasm.buf == NULL)
+        {
+            mqtt_reasm.buf = malloc(MQTT_CMD_REASM_MAX_LEN);
+            if (mqtt_reasm.buf == NULL)
+            {
+                ESP_LOGE(TAG, "No memory to reassemble command");
+                metrics_inc(METRIC_MQTT_CMD_DROPS);
+                return;
+            }
+        }
+        mqtt_reasm.total_len = event->total_data_len;
+        mqtt_reasm.received = 0;
+        mqtt_reasm.target_mask = target_mask;
+        mqtt_reasm.active = true;
+    }
+
+    if (!mqtt_reasm.active)
+        return;
+
+    if ((size_t)event->current_data_offset != mqtt_reasm.received ||
+        mqtt_reasm.received + event->data_len > mqtt_reasm.total_len)
+    {
+        ESP_LOGW(TAG, "Out of order command chunk, dropping message");
+        metrics_inc(METRIC_MQTT_CMD_DROPS);
+        mqtt_reasm.active = false;
+        return;
+    }
+
+    memcpy(&mqtt_reasm.buf[mqtt_reasm.received], event->data, event->data_len);
+    mqtt_reasm.received += event->data_len;
+
+    if (mqtt_reasm.received == mqtt_reasm.total_len)
+    {
+        mqtt_reasm.active = false;
+        metrics_inc(METRIC_MQTT_CMDS);
+        mqtt_queue_command(mqtt_reasm.buf, mqtt_reasm.total_len, mqtt_reasm.target_mask, pdMS_TO_TICKS(10));
+    }
+}
 
 static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_t event_id, void *event_data)
 {
@@ -19,55 +282,100 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_
     {
     case MQTT_EVENT_CONNECTED:
         ESP_LOGI(TAG, "MQTT connected");
-        esp_mqtt_client_subscribe(event->client, MQTT_TOPIC_SUB, 0);
+        metrics_inc(METRIC_MQTT_CONNECTS);
+        if (!mqtt_first_connect_logged)
+        {
+            ESP_LOGI(TAG, "Boot to MQTT connected: %" PRId64 " ms", esp_timer_get_time() / 1000);
+            mqtt_first_connect_logged = true;
+        }
+        esp_mqtt_client_subscribe(event->client, mqtt_config.topic_sub, 0);
+        esp_mqtt_client_subscribe(event->client, mqtt_config.topic_ch_sub, 0);
+        esp_mqtt_client_subscribe(event->client, mqtt_config.topic_log_level, 0);
         mqtt_connected = true;
+        indicator_set_pattern(INDICATE_ON);
+        esp_mqtt_client_publish(event->client, mqtt_config.topic_avail, MQTT_AVAIL_ONLINE, 0, 1, 1);
+        mqtt_send_to_publish(get_led_state());
         break;
     case MQTT_EVENT_DISCONNECTED:
         ESP_LOGI(TAG, "MQTT disconnecte");
+        metrics_inc(METRIC_MQTT_DISCONNECTS);
         mqtt_connected = false;
+        mqtt_reasm.active = false;
+        indicator_replace_pattern(INDICATE_ON, INDICATE_MQTT_DOWN);
         break;
     case MQTT_EVENT_DATA:
-        MqttData mqtt_data = {0};
-
-        printf("TOPIC = %.*s\r\n", event->topic_len, event->topic);
-        printf("DATA = %.*s\r\n", event->data_len, event->data);
-
-        mqtt_data.data_len = event->data_len < sizeof(mqtt_data.data) - 1 ? event->data_len :sizeof(mqtt_data.data) - 1;
-        memcpy(mqtt_data.data, event->data, mqtt_data.data_len);
-        mqtt_data.data[mqtt_data.data_len] = '\0'; 
-
-        if (xMqttSubQueue)
-            xQueueSend(xMqttSubQueue, &mqtt_data, pdMS_TO_TICKS(10));
+        mqtt_handle_data(event);
         break;
     default:
         break;
     }
 }
 
+// Publishes from any task but the client's own; nothing is sent while offline
+static int mqtt_publish(const char *topic, const char *data, size_t len, int qos, int retain)
+{
+    int msg_id = -1;
+
+    if (client_lock == NULL)
+        return msg_id;
+
+    xSemaphoreTake(client_lock, portMAX_DELAY);
+    if (client != NULL && mqtt_connected)
+        msg_id = esp_mqtt_client_publish(client, topic, data, len, qos, retain);
+    xSemaphoreGive(client_lock);
+    return msg_id;
+}
+
+// Runs in the log drain task; its own log lines go straight to the UART.
+// mqtt_publish() checks the connection under the client lock.
+static void mqtt_log_sink(const char *line, size_t len)
+{
+    mqtt_publish(mqtt_config.topic_log, line, len, 0, 0);
+}
+
 void mqtt_app_start(void)
 {
+    if (client_lock == NULL)
+        return;
+
+    xSemaphoreTake(client_lock, portMAX_DELAY);
     if(client != NULL)
     {
+        xSemaphoreGive(client_lock);
         ESP_LOGW(TAG, "MQTT client already started");
         return;
     }
 
+    // Picks up settings saved while a previous client was running
+    mqtt_config_load();
+
     const esp_mqtt_client_config_t mqtt_cfg = {
-        .broker.address.uri = MQTT_BROKER_URI,
+        .broker.address.uri = mqtt_config.settings.broker_uri,
+        .session.last_will = {
+            .topic = mqtt_config.topic_avail,
+            .msg = MQTT_AVAIL_OFFLINE,
+            .qos = 1,
+            .retain = 1,
+        },
     };
 
     client = esp_mqtt_client_init(&mqtt_cfg);
     esp_mqtt_client_register_event(client, ESP_EVENT_ANY_ID, mqtt_event_handler, NULL);
     esp_mqtt_client_start(client);
+    xSemaphoreGive(client_lock);
+    log_stream_set_sink(mqtt_log_sink);
 }
 
 void vTaskMqttPublish(void *pvParameter)
 {
-    MqttData mqtt_data;
-    uint8_t command;
+    uint32_t command;
     char json_data[MQTT_DATA_MAX_LEN] = {0};
+    size_t json_len = 0;
 
-    xMqttPubQueue = xQueueCreate(10, sizeof(uint8_t));
+    parse_init();
+
+    // Single-slot mailbox: a newer state always replaces one not yet published
+    xMqttPubQueue = xQueueCreate(1, sizeof(uint32_t));
     if (xMqttPubQueue == NULL) {
         ESP_LOGE(TAG, "xMqttPubQueue is NULL!");
         vTaskDelete(NULL);
@@ -76,36 +384,74 @@ void vTaskMqttPublish(void *pvParameter)
     {
         if(xQueueReceive(xMqttPubQueue, &command, portMAX_DELAY))
         {
+            BENCH_MARK(BENCH_STAGE_PUB_DEQUEUED);
             if(mqtt_connected)
             {
-                if (build_mqtt_state_json(json_data, MQTT_DATA_MAX_LEN, command) == ESP_OK)
+                if (build_mqtt_state_json(json_data, MQTT_DATA_MAX_LEN, command, &json_len) == ESP_OK)
                 {
-                    strcpy(mqtt_data.data, json_data);
-                    mqtt_data.data_len = strlen(json_data);
-                    ESP_LOGI(TAG, "Received data from queue: %s", mqtt_data.data);
-                    esp_mqtt_client_publish(client, MQTT_TOPIC_PUB, mqtt_data.data, mqtt_data.data_len, 1, 0);
+                    BENCH_MARK(BENCH_STAGE_PUB_BUILT);
+                    ESP_LOGI(TAG, "Received data from queue: %s", json_data);
+                    int64_t publish_start = esp_timer_get_time();
+                    // A skipped publish returns at once, it must not show up as a fast one
+                    if (mqtt_publish(mqtt_config.topic_pub, json_data, json_len, 1, 1) >= 0)
+                    {
+                        metrics_record_us(METRIC_HIST_PUBLISH_US, esp_timer_get_time() - publish_start);
+                        metrics_inc(METRIC_MQTT_PUBLISHES);
+                    }
+                    else
+                    {
+                        metrics_inc(METRIC_MQTT_PUBLISH_FAILS);
+                    }
                 }
             }
+            BENCH_MARK(BENCH_STAGE_PUB_SENT);
+        }
+    }
+}
+
+// Low priority: a report delayed behind relay traffic costs nothing
+void vTaskMqttMetrics(void *pvParameter)
+{
+    static char json_data[METRICS_JSON_MAX_LEN];
+    size_t json_len = 0;
+
+    while (1)
+    {
+        vTaskDelay(pdMS_TO_TICKS(METRICS_REPORT_INTERVAL_MS));
+        if (mqtt_connected && metrics_build_json(json_data, sizeof(json_data), &json_len) == ESP_OK)
+        {
+            mqtt_publish(mqtt_config.topic_metrics, json_data, json_len, 0, 0);
         }
     }
 }
 
 void mqtt_app_stop()
 {
+    if (client_lock == NULL)
+        return;
+
+    xSemaphoreTake(client_lock, portMAX_DELAY);
     if(client !=NULL)
     {
+        log_stream_set_sink(NULL);
+        // A clean disconnect suppresses the last will, so announce it ourselves
+        if (mqtt_connected)
+        {
+            esp_mqtt_client_publish(client, mqtt_config.topic_avail, MQTT_AVAIL_OFFLINE, 0, 1, 1);
+        }
+        mqtt_connected = false;
         esp_mqtt_client_stop(client);
         esp_mqtt_client_destroy(client);
         client = NULL;
-        mqtt_connected = false;
     }
+    xSemaphoreGive(client_lock);
 }
 
-void mqtt_send_to_publish(uint8_t command)
+void mqtt_send_to_publish(uint32_t command)
 {
     if (xMqttPubQueue != NULL)
     {
-        xQueueSend(xMqttPubQueue, &command, pdMS_TO_TICKS(100));
+        xQueueOverwrite(xMqttPubQueue, &command);
     }
     else
     {
@@ -115,32 +461,29 @@ void mqtt_send_to_publish(uint8_t command)
 
 void vTaskParseFromMqtt(void *pvParameter)
 {
-    MqttData mqtt_data;
-    xMqttSubQueue = xQueueCreate(10, sizeof(MqttData));
+    // Commands arrive already decoded, a slot is a mask plus an op
+    xMqttSubQueue = xQueueCreate(MQTT_CMD_QUEUE_LEN, sizeof(led_command_t));
     if (xMqttSubQueue == NULL) {
         ESP_LOGE(TAG, "xMqttSubQueue is NULL!");
         vTaskDelete(NULL);
     }
-    uint8_t state = 0;
+    led_command_t cmd;
     while (1)
     {
-        if (xQueueReceive(xMqttSubQueue, &mqtt_data, portMAX_DELAY))
+        if (xQueueReceive(xMqttSubQueue, &cmd, portMAX_DELAY))
         {
-            if(parse_mqtt_state_json(mqtt_data.data, &state) == ESP_OK)
-            {
-                if (state < (1<<COUNT_BUTTONS))
-                {
-                    switch_led_state(state);
-                }else
-                {
-                    ESP_LOGE(TAG, "Failed to parse state from MQTT data");
-                }
-            }
-            else
-            {
-                ESP_LOGE(TAG, "Failed to parse state from MQTT data");
-                continue;
-            }
+            BENCH_MARK(BENCH_STAGE_CMD_DEQUEUED);
+            uint32_t state = apply_led_command(&cmd);
+            BENCH_MARK(BENCH_STAGE_CMD_APPLIED);
+            mqtt_send_to_publish(state);
         }
     }
 }
+
+#if LATENCY_BENCH
+// Takes the same parse-and-queue step as MQTT_EVENT_DATA, without a broker
+esp_err_t mqtt_bench_command(const char *data, size_t data_len, uint32_t target_mask)
+{
+    return mqtt_queue_command(data, data_len, target_mask, 0);
+}
+#endif
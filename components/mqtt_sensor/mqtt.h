@@ -3,22 +3,59 @@
 
 #include "esp_log.h"
 #include "mqtt_client.h"
+#include "latency_bench.h"
 
 #define MQTT_DATA_MAX_LEN   256
-#define MQTT_BROKER_URI     "mqtt://192.168.0.102:1883"
-#define MQTT_TOPIC_SUB      "home/rooms/living/lights/id1/cmd"
-#define MQTT_TOPIC_PUB      "home/rooms/living/lights/id1/state"
+// Commands split over several MQTT_EVENT_DATA events are reassembled up to this size
+#define MQTT_CMD_REASM_MAX_LEN  512
+#define MQTT_CMD_QUEUE_LEN      10
+#define MQTT_URI_MAX_LEN        128
+#define MQTT_BASE_TOPIC_MAX_LEN 96
+#define MQTT_DEVICE_ID_MAX_LEN  32
+#define MQTT_TOPIC_MAX_LEN      (MQTT_BASE_TOPIC_MAX_LEN + MQTT_DEVICE_ID_MAX_LEN + 16)
+
+// Used until the user stores other values through the captive portal
+#define MQTT_DEFAULT_BROKER_URI "mqtt://192.168.0.102:1883"
+#define MQTT_DEFAULT_BASE_TOPIC "home/rooms/living/lights"
+#define MQTT_DEFAULT_DEVICE_ID  "id1"
+// In mqtt_config_save(): an empty field keeps the stored value, this one restores the default
+#define MQTT_SETTING_RESET      "-"
+
+// Topics are <base>/<device_id>/<suffix>
+#define MQTT_TOPIC_SUB_SUFFIX   "/cmd"
+#define MQTT_TOPIC_PUB_SUFFIX   "/state"
+#define MQTT_TOPIC_AVAIL_SUFFIX "/availability"
+#define MQTT_TOPIC_METRICS_SUFFIX "/metrics"
+#define MQTT_TOPIC_LOG_SUFFIX   "/log"
+// Payload "<tag>=<level>", see log_stream_apply_setting()
+#define MQTT_TOPIC_LOG_LEVEL_SUFFIX "/log/level"
+
+#define MQTT_AVAIL_ONLINE   "online"
+#define MQTT_AVAIL_OFFLINE  "offline"
+
+// Per-channel commands: <base>/<device_id>/ch/<n>/cmd, n is the zero-based channel index
+#define MQTT_TOPIC_CH_INFIX     "/ch/"
+#define MQTT_TOPIC_CH_SUFFIX    "/cmd"
 
 typedef struct {
-    char data[MQTT_DATA_MAX_LEN]; 
-    uint16_t data_len;
-} MqttData;
+    char broker_uri[MQTT_URI_MAX_LEN];
+    char base_topic[MQTT_BASE_TOPIC_MAX_LEN];
+    char device_id[MQTT_DEVICE_ID_MAX_LEN];
+} mqtt_settings_t;
 
+void mqtt_config_load(void);
+esp_err_t mqtt_config_save(const mqtt_settings_t *settings);
+void mqtt_config_get(mqtt_settings_t *out_settings);
 void mqtt_app_start(void);
 void mqtt_app_stop(void);
-void mqtt_send_to_publish(uint8_t command);
+void mqtt_send_to_publish(uint32_t command);
 
 void vTaskMqttPublish(void *pvParameter);
 void vTaskParseFromMqtt(void* pvParameter);
+void vTaskMqttMetrics(void *pvParameter);
+
+#if LATENCY_BENCH
+esp_err_t mqtt_bench_command(const char *data, size_t data_len, uint32_t target_mask);
+#endif
 
 #endif /* MQTT_H_ */
\ No newline at end of file
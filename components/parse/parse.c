@@ -1,100 +1,410 @@
 #include "parse.h"
-#include "cJSON.h"
 #include <string.h>
+#include <stdbool.h>
 
+#define JSON_KEY_STATE      "state"
 #define JSON_KEY_STATES     "states"
+#define JSON_VALUE_ON       "ON"
+#define JSON_VALUE_OFF      "OFF"
+#define JSON_VALUE_TOGGLE   "TOGGLE"
+#define JSON_MAX_DEPTH      8
+
+#define STATE_JSON_PREFIX   "{\"" JSON_KEY_STATES "\":["
+#define STATE_JSON_SUFFIX   "]}"
+#define STATE_JSON_ITEM_MAX (sizeof("\"OFF\",") - 1)
+
+// The state payload is stitched from fragments covering 4 channels each, so
+// the table stays at 16 entries whatever COUNT_BUTTONS is
+#define STATE_JSON_GROUP_BITS   4
+#define STATE_JSON_GROUP_COUNT  (1 << STATE_JSON_GROUP_BITS)
+#define STATE_JSON_GROUPS       ((COUNT_BUTTONS + STATE_JSON_GROUP_BITS - 1) / STATE_JSON_GROUP_BITS)
 
 static const char *TAG = "PARSE";
 
-esp_err_t parse_mqtt_state_json(const char *json_data, uint8_t *out_state)
+typedef struct {
+    const char *pos;
+    const char *end;
+} json_cursor_t;
+
+typedef struct {
+    const char *str;
+    size_t len;
+} json_span_t;
+
+typedef struct {
+    char text[STATE_JSON_GROUP_BITS * STATE_JSON_ITEM_MAX];  // every item followed by ','
+    uint8_t cut[STATE_JSON_GROUP_BITS + 1];                  // length of the first k items
+} state_json_group_t;
+
+static state_json_group_t state_json_groups[STATE_JSON_GROUP_COUNT];
+static bool state_json_ready = false;
+
+static void json_skip_ws(json_cursor_t *cur)
 {
-    if (!json_data || !out_state)
-        return ESP_ERR_INVALID_ARG;
+    while (cur->pos < cur->end &&
+           (*cur->pos == ' ' || *cur->pos == '\t' || *cur->pos == '\n' || *cur->pos == '\r'))
+    {
+        cur->pos++;
+    }
+}
 
-    cJSON *root = cJSON_Parse(json_data);
-    if (!root)
+static bool json_consume(json_cursor_t *cur, char c)
+{
+    json_skip_ws(cur);
+    if (cur->pos < cur->end && *cur->pos == c)
     {
-        ESP_LOGE(TAG, "Failed to parse JSON data");
-        return ESP_FAIL;
+        cur->pos++;
+        return true;
     }
+    return false;
+}
 
-    cJSON *arr = cJSON_GetObjectItem(root, JSON_KEY_STATES);
-    if (!cJSON_IsArray(arr))
+static bool json_peek(json_cursor_t *cur, char c)
+{
+    json_skip_ws(cur);
+    return cur->pos < cur->end && *cur->pos == c;
+}
+
+// Returns the raw (still escaped) contents of a string token without copying it
+static bool json_read_string(json_cursor_t *cur, json_span_t *out)
+{
+    if (!json_consume(cur, '"'))
+        return false;
+
+    out->str = cur->pos;
+    while (cur->pos < cur->end && *cur->pos != '"')
     {
-        ESP_LOGE(TAG, "'states' is missing or not an array");
-        cJSON_Delete(root);
-        return ESP_FAIL;
+        if ((unsigned char)*cur->pos < 0x20)
+            return false;
+        if (*cur->pos == '\\')
+        {
+            cur->pos++;
+            if (cur->pos >= cur->end)
+                return false;
+        }
+        cur->pos++;
     }
+    if (cur->pos >= cur->end)
+        return false;
 
-    uint32_t arr_size = cJSON_GetArraySize(arr);
-    uint8_t state = 0;
+    out->len = cur->pos - out->str;
+    cur->pos++;
+    return true;
+}
+
+static bool json_span_equals(const json_span_t *span, const char *literal)
+{
+    size_t len = strlen(literal);
+    return span->len == len && memcmp(span->str, literal, len) == 0;
+}
+
+static bool json_skip_keyword(json_cursor_t *cur, const char *keyword)
+{
+    size_t len = strlen(keyword);
+    if ((size_t)(cur->end - cur->pos) < len || memcmp(cur->pos, keyword, len) != 0)
+        return false;
+    cur->pos += len;
+    return true;
+}
 
-    for (uint8_t i = 0; i < arr_size && i < COUNT_BUTTONS; i++)
+static bool json_is_digit(const json_cursor_t *cur)
+{
+    return cur->pos < cur->end && *cur->pos >= '0' && *cur->pos <= '9';
+}
+
+static void json_skip_digits(json_cursor_t *cur)
+{
+    while (json_is_digit(cur))
+        cur->pos++;
+}
+
+// -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)?
+static bool json_skip_number(json_cursor_t *cur)
+{
+    if (cur->pos < cur->end && *cur->pos == '-')
+        cur->pos++;
+
+    if (!json_is_digit(cur))
+        return false;
+    if (*cur->pos++ != '0')
+        json_skip_digits(cur);
+
+    if (cur->pos < cur->end && *cur->pos == '.')
+    {
+        cur->pos++;
+        if (!json_is_digit(cur))
+            return false;
+        json_skip_digits(cur);
+    }
+
+    if (cur->pos < cur->end && (*cur->pos == 'e' || *cur->pos == 'E'))
+    {
+        cur->pos++;
+        if (cur->pos < cur->end && (*cur->pos == '+' || *cur->pos == '-'))
+            cur->pos++;
+        if (!json_is_digit(cur))
+            return false;
+        json_skip_digits(cur);
+    }
+    return true;
+}
+
+static bool json_skip_value(json_cursor_t *cur, uint8_t depth);
+
+static bool json_skip_container(json_cursor_t *cur, char close, bool is_object, uint8_t depth)
+{
+    if (json_consume(cur, close))
+        return true;
+
+    do
     {
-        cJSON* curr_item = cJSON_GetArrayItem(arr, i);
-        if(!curr_item)
+        if (is_object)
         {
-            ESP_LOGW(TAG, "Missing item in 'states' at index %d", i);
-            continue;
+            json_span_t key;
+            if (!json_read_string(cur, &key) || !json_consume(cur, ':'))
+                return false;
         }
-        if (cJSON_IsString(curr_item) && curr_item->valuestring)
+        if (!json_skip_value(cur, depth + 1))
+            return false;
+    } while (json_consume(cur, ','));
+
+    return json_consume(cur, close);
+}
+
+static bool json_skip_value(json_cursor_t *cur, uint8_t depth)
+{
+    if (depth > JSON_MAX_DEPTH)
+        return false;
+
+    json_skip_ws(cur);
+    if (cur->pos >= cur->end)
+        return false;
+
+    json_span_t span;
+    switch (*cur->pos)
+    {
+    case '"':
+        return json_read_string(cur, &span);
+    case '{':
+        cur->pos++;
+        return json_skip_container(cur, '}', true, depth);
+    case '[':
+        cur->pos++;
+        return json_skip_container(cur, ']', false, depth);
+    case 't':
+        return json_skip_keyword(cur, "true");
+    case 'f':
+        return json_skip_keyword(cur, "false");
+    case 'n':
+        return json_skip_keyword(cur, "null");
+    default:
+        return json_skip_number(cur);
+    }
+}
+
+static bool json_parse_states_array(json_cursor_t *cur, uint32_t *out_state)
+{
+    uint32_t state = 0;
+
+    if (!json_consume(cur, '['))
+        return false;
+    if (json_consume(cur, ']'))
+    {
+        *out_state = state;
+        return true;
+    }
+
+    uint8_t i = 0;
+    do
+    {
+        if (json_peek(cur, '"'))
         {
-            if (!strcmp(curr_item->valuestring, "ON"))
+            json_span_t item;
+            if (!json_read_string(cur, &item))
+                return false;
+            if (i < COUNT_BUTTONS && json_span_equals(&item, JSON_VALUE_ON))
             {
-                state |= (1 << i);
+                state |= (1UL << i);
             }
         }
         else
         {
-            ESP_LOGW(TAG, "Invalid item in 'states' at index %d", i);
+            if (!json_skip_value(cur, 1))
+                return false;
+            if (i < COUNT_BUTTONS)
+                ESP_LOGW(TAG, "Invalid item in 'states' at index %d", i);
         }
-    }
+        if (i < UINT8_MAX)
+            i++;
+    } while (json_consume(cur, ','));
+
+    if (!json_consume(cur, ']'))
+        return false;
+
     *out_state = state;
-    cJSON_Delete(root);
-    return ESP_OK; 
+    return true;
 }
 
-esp_err_t build_mqtt_state_json(char *json_buf, size_t buf_size, uint8_t state)
+static bool json_parse_state_value(const json_span_t *value, uint32_t target_mask, led_command_t *out_cmd)
 {
-    if (!json_buf || buf_size == 0)
+    out_cmd->mask = target_mask;
+    if (json_span_equals(value, JSON_VALUE_ON))
+        out_cmd->op = LED_CMD_SET;
+    else if (json_span_equals(value, JSON_VALUE_OFF))
+        out_cmd->op = LED_CMD_CLEAR;
+    else if (json_span_equals(value, JSON_VALUE_TOGGLE))
+        out_cmd->op = LED_CMD_TOGGLE;
+    else
+        return false;
+    return true;
+}
+
+esp_err_t parse_mqtt_command_json(const char *json_data, size_t data_len, uint32_t target_mask, led_command_t *out_cmd)
+{
+    if (!json_data || !out_cmd || (target_mask & ~LED_STATE_MASK) || target_mask == 0)
         return ESP_ERR_INVALID_ARG;
 
-    cJSON *root = cJSON_CreateObject();
-    if (!root)
+    json_cursor_t cur = {
+        .pos = json_data,
+        .end = json_data + data_len,
+    };
+
+    // "states" addresses the whole device, so it is only honoured on the device topic
+    bool allow_states = (target_mask == LED_STATE_MASK);
+    bool found = false;
+    led_command_t cmd = {0};
+
+    if (!json_consume(&cur, '{'))
     {
-        ESP_LOGE(TAG, "Failed to create JSON object");
-        return ESP_FAIL; 
-    }
-    cJSON *arr = cJSON_CreateArray();
-    if (!arr) {
-        cJSON_Delete(root);
+        ESP_LOGE(TAG, "Failed to parse JSON data");
         return ESP_FAIL;
     }
 
-    for (uint8_t i = 0; i < COUNT_BUTTONS; i++)
+    if (!json_consume(&cur, '}'))
     {
-        cJSON_AddItemToArray(arr, cJSON_CreateString((state & (1 << i)) ? "ON" : "OFF"));
+        do
+        {
+            json_span_t key;
+            if (!json_read_string(&cur, &key) || !json_consume(&cur, ':'))
+            {
+                ESP_LOGE(TAG, "Failed to parse JSON data");
+                return ESP_FAIL;
+            }
+
+            if (!found && allow_states && json_span_equals(&key, JSON_KEY_STATES))
+            {
+                if (!json_peek(&cur, '['))
+                {
+                    ESP_LOGE(TAG, "'states' is missing or not an array");
+                    return ESP_FAIL;
+                }
+                if (!json_parse_states_array(&cur, &cmd.mask))
+                {
+                    ESP_LOGE(TAG, "Failed to parse JSON data");
+                    return ESP_FAIL;
+                }
+                cmd.op = LED_CMD_ASSIGN;
+                found = true;
+            }
+            else if (!found && json_span_equals(&key, JSON_KEY_STATE))
+            {
+                json_span_t value;
+                if (!json_peek(&cur, '"') || !json_read_string(&cur, &value))
+                {
+                    ESP_LOGE(TAG, "'state' is not a string");
+                    return ESP_FAIL;
+                }
+                if (!json_parse_state_value(&value, target_mask, &cmd))
+                {
+                    ESP_LOGE(TAG, "'state' must be ON, OFF or TOGGLE");
+                    return ESP_FAIL;
+                }
+                found = true;
+            }
+            else if (!json_skip_value(&cur, 1))
+            {
+                ESP_LOGE(TAG, "Failed to parse JSON data");
+                return ESP_FAIL;
+            }
+        } while (json_consume(&cur, ','));
+
+        if (!json_consume(&cur, '}'))
+        {
+            ESP_LOGE(TAG, "Failed to parse JSON data");
+            return ESP_FAIL;
+        }
     }
-    
-    cJSON_AddItemToObject(root, JSON_KEY_STATES, arr); 
 
-    char *out = cJSON_PrintUnformatted(root);
-    if (!out) {
-        cJSON_Delete(root);
+    if (!found)
+    {
+        ESP_LOGE(TAG, "'state' or 'states' is missing");
         return ESP_FAIL;
     }
 
-    if (strlen(out) >= buf_size) {
+    *out_cmd = cmd;
+    return ESP_OK;
+}
+
+void parse_init(void)
+{
+    for (uint8_t bits = 0; bits < STATE_JSON_GROUP_COUNT; bits++)
+    {
+        state_json_group_t *group = &state_json_groups[bits];
+        size_t len = 0;
+
+        group->cut[0] = 0;
+        for (uint8_t i = 0; i < STATE_JSON_GROUP_BITS; i++)
+        {
+            const char *item = (bits & (1 << i)) ? "\"ON\"," : "\"OFF\",";
+            memcpy(&group->text[len], item, strlen(item));
+            len += strlen(item);
+            group->cut[i + 1] = len;
+        }
+    }
+    state_json_ready = true;
+}
+
+esp_err_t build_mqtt_state_json(char *json_buf, size_t buf_size, uint32_t state, size_t *out_len)
+{
+    if (!json_buf || buf_size == 0)
+        return ESP_ERR_INVALID_ARG;
+
+    if (!state_json_ready)
+    {
+        ESP_LOGE(TAG, "State JSON table is not initialized");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    size_t len = sizeof(STATE_JSON_PREFIX) - 1;
+    if (len >= buf_size) {
         ESP_LOGE(TAG, "JSON too long");
-        cJSON_free(out);
-        cJSON_Delete(root);
         return ESP_ERR_NO_MEM;
     }
+    memcpy(json_buf, STATE_JSON_PREFIX, len);
 
-    strcpy(json_buf, out);
+    for (uint8_t g = 0; g < STATE_JSON_GROUPS; g++)
+    {
+        uint8_t channels = COUNT_BUTTONS - g * STATE_JSON_GROUP_BITS;
+        if (channels > STATE_JSON_GROUP_BITS)
+            channels = STATE_JSON_GROUP_BITS;
+
+        const state_json_group_t *group = &state_json_groups[(state >> (g * STATE_JSON_GROUP_BITS)) & (STATE_JSON_GROUP_COUNT - 1)];
+        size_t n = group->cut[channels];
 
-    cJSON_free(out);
-    cJSON_Delete(root);
+        // The trailing ',' is later replaced by the suffix and the terminator
+        if (len + n + sizeof(STATE_JSON_SUFFIX) - 1 > buf_size) {
+            ESP_LOGE(TAG, "JSON too long");
+            return ESP_ERR_NO_MEM;
+        }
+        memcpy(&json_buf[len], group->text, n);
+        len += n;
+    }
+
+    len--;
+    memcpy(&json_buf[len], STATE_JSON_SUFFIX, sizeof(STATE_JSON_SUFFIX));
+    len += sizeof(STATE_JSON_SUFFIX) - 1;
+
+    if (out_len)
+        *out_len = len;
     return ESP_OK;
 }
-
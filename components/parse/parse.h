@@ -6,8 +6,9 @@
 #include <stdint.h>
 #include "shearch_component.h"
 
-esp_err_t parse_mqtt_state_json(const char *json_data, uint8_t *out_state);
-esp_err_t build_mqtt_state_json(char *json_buf, size_t buf_size, uint8_t state);
+void parse_init(void);
+esp_err_t parse_mqtt_command_json(const char *json_data, size_t data_len, uint32_t target_mask, led_command_t *out_cmd);
+esp_err_t build_mqtt_state_json(char *json_buf, size_t buf_size, uint32_t state, size_t *out_len);
 
 
 #endif /* PARSE_H_ */
\ No newline at end of file
@@ -7,7 +7,27 @@
 #include "esp_log.h"
 #include "esp_err.h"
 
+// Number of rows in the channel table in control.h, at most 32 (one bit per channel).
+// Overridable so the host tests can build the channel-count dependent code for every size.
+#ifndef COUNT_BUTTONS
 #define COUNT_BUTTONS   3
+#endif
+#define LED_STATE_MASK  ((uint32_t)(0xFFFFFFFFULL >> (32 - COUNT_BUTTONS)))
+
+_Static_assert(COUNT_BUTTONS > 0 && COUNT_BUTTONS <= 32, "COUNT_BUTTONS must be 1..32");
+
+typedef enum
+{
+    LED_CMD_ASSIGN = 0,     // mask becomes the new state
+    LED_CMD_SET,            // channels in mask are switched on
+    LED_CMD_CLEAR,          // channels in mask are switched off
+    LED_CMD_TOGGLE          // channels in mask are inverted
+} LedCommandOp_t;
+
+typedef struct {
+    uint32_t mask;
+    uint8_t op;
+} led_command_t;
 
 
 
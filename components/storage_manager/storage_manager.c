@@ -1,7 +1,72 @@
 #include "storage_manager.h"
 
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+#include "metrics.h"
+
 static const char *TAG = "STORAGE_MANAGER";
 
+typedef enum {
+    STORAGE_TYPE_STR = 0,
+    STORAGE_TYPE_BLOB,
+    STORAGE_TYPE_U32,
+} StorageType_t;
+
+typedef struct {
+    const char *name;       // NVS key, at most 15 characters
+    StorageType_t type;
+    uint16_t max_len;       // including the terminator for strings
+    bool secret;            // never logged
+    bool present;
+    bool dirty;
+    uint16_t len;
+    uint8_t value[STORAGE_VALUE_MAX_LEN] __attribute__((aligned(4)));
+} storage_entry_t;
+
+#define STORAGE_ENTRY(_name, _type, _max_len, _secret) \
+    { .name = _name, .type = _type, .max_len = _max_len, .secret = _secret }
+
+static storage_entry_t storage_entries[STORAGE_KEY_COUNT] = {
+    [STORAGE_KEY_WIFI_SSID] = STORAGE_ENTRY("ssid", STORAGE_TYPE_STR, 64, false),
+    [STORAGE_KEY_WIFI_PASS] = STORAGE_ENTRY("pass", STORAGE_TYPE_STR, 64, true),
+    [STORAGE_KEY_MQTT_URI]  = STORAGE_ENTRY("mqtt_uri", STORAGE_TYPE_STR, 128, false),
+    [STORAGE_KEY_MQTT_BASE] = STORAGE_ENTRY("mqtt_base", STORAGE_TYPE_STR, 96, false),
+    [STORAGE_KEY_MQTT_ID]   = STORAGE_ENTRY("mqtt_id", STORAGE_TYPE_STR, 32, false),
+    [STORAGE_KEY_STA_FAST]  = STORAGE_ENTRY("sta_fast", STORAGE_TYPE_BLOB, 64, false),
+    [STORAGE_KEY_RELAY_STATE] = STORAGE_ENTRY("relay_state", STORAGE_TYPE_U32, sizeof(uint32_t), false),
+};
+
+static nvs_handle_t storage_handle;
+static SemaphoreHandle_t storage_mutex = NULL;
+
+
+static void storage_load_entry(storage_entry_t *entry)
+{
+    size_t len = entry->max_len;
+    esp_err_t err;
+
+    if (entry->type == STORAGE_TYPE_STR)
+        err = nvs_get_str(storage_handle, entry->name, (char *)entry->value, &len);
+    else if (entry->type == STORAGE_TYPE_U32)
+        err = nvs_get_u32(storage_handle, entry->name, (uint32_t *)entry->value);
+    else
+        err = nvs_get_blob(storage_handle, entry->name, entry->value, &len);
+
+    entry->present = (err == ESP_OK);
+    entry->len = entry->present ? len : 0;
+    if (err == ESP_OK)
+    {
+        if (entry->type == STORAGE_TYPE_STR)
+            ESP_LOGI(TAG, "'%s': '%s'", entry->name, entry->secret ? "***" : (const char *)entry->value);
+    }
+    else if (err != ESP_ERR_NVS_NOT_FOUND)
+    {
+        ESP_LOGW(TAG, "NVS read of '%s' failed: %s", entry->name, esp_err_to_name(err));
+    }
+}
+
 
 esp_err_t storage_init()
 {
@@ -12,49 +77,181 @@ esp_err_t storage_init()
         err = nvs_flash_init();
     }
     ESP_ERROR_CHECK(err);
-    return err;
+
+    storage_mutex = xSemaphoreCreateMutex();
+    if (storage_mutex == NULL)
+    {
+        ESP_LOGE(TAG, "Failed to create storage mutex");
+        return ESP_ERR_NO_MEM;
+    }
+
+    // The handle stays open, all later reads come from the RAM mirror
+    err = nvs_open(STORAGE_NAMESPACE, NVS_READWRITE, &storage_handle);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "NVS open failed: %s", esp_err_to_name(err));
+        vSemaphoreDelete(storage_mutex);
+        storage_mutex = NULL;
+        return err;
+    }
+
+    for (uint8_t i = 0; i < STORAGE_KEY_COUNT; i++)
+    {
+        storage_load_entry(&storage_entries[i]);
+    }
+    return ESP_OK;
 }
 
 
-esp_err_t storage_set_str(const char *key, const char *value)
+static esp_err_t storage_set(StorageKey_t key, StorageType_t type, const void *value, size_t length)
 {
-    nvs_handle_t handle;
-    if (nvs_open(STORAGE_NAMESPACE, NVS_READWRITE, &handle) == ESP_OK)
+    if (key >= STORAGE_KEY_COUNT || storage_entries[key].type != type || !value)
+        return ESP_ERR_INVALID_ARG;
+    if (!storage_mutex)
+        return ESP_ERR_INVALID_STATE;
+
+    storage_entry_t *entry = &storage_entries[key];
+    if (length > entry->max_len)
+    {
+        ESP_LOGW(TAG, "'%s' is too long (%u > %u)", entry->name, (unsigned)length, entry->max_len);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    xSemaphoreTake(storage_mutex, portMAX_DELAY);
+    if (!entry->present || entry->len != length || memcmp(entry->value, value, length) != 0)
     {
-        nvs_set_str(handle, key, value);
-        nvs_commit(handle);
-        nvs_close(handle);
-        ESP_LOGI(TAG, "Credentials saved to NVS");
-        return ESP_OK;
+        memcpy(entry->value, value, length);
+        entry->len = length;
+        entry->present = true;
+        entry->dirty = true;
     }
-    ESP_LOGW(TAG, "NVS open failed; creds not saved");
-    return ESP_FAIL;
+    xSemaphoreGive(storage_mutex);
+    return ESP_OK;
+}
+
+
+static esp_err_t storage_get(StorageKey_t key, StorageType_t type, void *value, size_t length)
+{
+    if (key >= STORAGE_KEY_COUNT || storage_entries[key].type != type || !value)
+        return ESP_ERR_INVALID_ARG;
+    if (!storage_mutex)
+        return ESP_ERR_INVALID_STATE;
+
+    storage_entry_t *entry = &storage_entries[key];
+    esp_err_t err = ESP_OK;
+
+    xSemaphoreTake(storage_mutex, portMAX_DELAY);
+    if (!entry->present)
+        err = ESP_ERR_NVS_NOT_FOUND;
+    // Strings may be read into a larger buffer, blobs and numbers must match exactly so a
+    // record saved with a different layout is reported instead of half-read
+    else if (type == STORAGE_TYPE_STR ? entry->len > length : entry->len != length)
+        err = ESP_ERR_NVS_INVALID_LENGTH;
+    else
+        memcpy(value, entry->value, entry->len);
+    xSemaphoreGive(storage_mutex);
+    return err;
 }
 
 
-esp_err_t storage_get_str(const char *key, char *value, size_t length)
+esp_err_t storage_set_str(StorageKey_t key, const char *value)
 {
-    // Read from NVS
-    nvs_handle_t handle;
-    if (nvs_open(STORAGE_NAMESPACE, NVS_READONLY, &handle) == ESP_OK)
+    return storage_set(key, STORAGE_TYPE_STR, value, value ? strlen(value) + 1 : 0);
+}
+
+
+esp_err_t storage_get_str(StorageKey_t key, char *value, size_t length)
+{
+    return storage_get(key, STORAGE_TYPE_STR, value, length);
+}
+
+
+esp_err_t storage_set_blob(StorageKey_t key, const void *value, size_t length)
+{
+    return storage_set(key, STORAGE_TYPE_BLOB, value, length);
+}
+
+
+esp_err_t storage_get_blob(StorageKey_t key, void *value, size_t length)
+{
+    return storage_get(key, STORAGE_TYPE_BLOB, value, length);
+}
+
+
+esp_err_t storage_set_u32(StorageKey_t key, uint32_t value)
+{
+    return storage_set(key, STORAGE_TYPE_U32, &value, sizeof(value));
+}
+
+
+esp_err_t storage_get_u32(StorageKey_t key, uint32_t *value)
+{
+    return storage_get(key, STORAGE_TYPE_U32, value, sizeof(*value));
+}
+
+
+esp_err_t storage_commit(void)
+{
+    if (!storage_mutex)
+        return ESP_ERR_INVALID_STATE;
+
+    esp_err_t err = ESP_OK;
+    uint8_t written = 0;
+
+    xSemaphoreTake(storage_mutex, portMAX_DELAY);
+    int64_t start = esp_timer_get_time();
+    for (uint8_t i = 0; i < STORAGE_KEY_COUNT && err == ESP_OK; i++)
+    {
+        storage_entry_t *entry = &storage_entries[i];
+        if (!entry->dirty)
+            continue;
+
+        if (entry->type == STORAGE_TYPE_STR)
+            err = nvs_set_str(storage_handle, entry->name, (const char *)entry->value);
+        else if (entry->type == STORAGE_TYPE_U32)
+            err = nvs_set_u32(storage_handle, entry->name, *(const uint32_t *)entry->value);
+        else
+            err = nvs_set_blob(storage_handle, entry->name, entry->value, entry->len);
+        written++;
+    }
+    if (err == ESP_OK && written)
+    {
+        err = nvs_commit(storage_handle);
+        metrics_record_us(METRIC_HIST_NVS_COMMIT_US, esp_timer_get_time() - start);
+    }
+    if (err == ESP_OK)
     {
-        esp_err_t err = nvs_get_str(handle, key, value, &length);
-        nvs_close(handle);
-        ESP_LOGI(TAG, "'%s': '%s'", key, value);
-        if(err != ESP_OK)
-        {
-            ESP_LOGW(TAG, "NVS read failed; creds may be invalid");
-            return err;
-        }
-        return ESP_OK;
+        for (uint8_t i = 0; i < STORAGE_KEY_COUNT; i++)
+            storage_entries[i].dirty = false;
     }
-    ESP_LOGW(TAG, "NVS open failed; creds do not saved");
-    return ESP_FAIL;
+    xSemaphoreGive(storage_mutex);
+
+    if (err != ESP_OK)
+    {
+        ESP_LOGW(TAG, "NVS commit failed: %s", esp_err_to_name(err));
+        return err;
+    }
+    if (written)
+        ESP_LOGI(TAG, "Committed %u key(s) to NVS", written);
+    return ESP_OK;
 }
 
 
 esp_err_t storage_erase_all()
 {
-    esp_err_t err = nvs_flash_erase();
+    if (!storage_mutex)
+        return nvs_flash_erase();
+
+    xSemaphoreTake(storage_mutex, portMAX_DELAY);
+    esp_err_t err = nvs_erase_all(storage_handle);
+    if (err == ESP_OK)
+        err = nvs_commit(storage_handle);
+    for (uint8_t i = 0; i < STORAGE_KEY_COUNT; i++)
+    {
+        storage_entries[i].present = false;
+        storage_entries[i].dirty = false;
+        storage_entries[i].len = 0;
+    }
+    xSemaphoreGive(storage_mutex);
     return err;
 }
@@ -13,11 +13,32 @@
 
 
 #define STORAGE_NAMESPACE "wifi_creds"
-
+#define STORAGE_VALUE_MAX_LEN 128
+
+// Every persisted setting has a fixed key, type and size (see storage_manager.c)
+typedef enum {
+    STORAGE_KEY_WIFI_SSID = 0,
+    STORAGE_KEY_WIFI_PASS,
+    STORAGE_KEY_MQTT_URI,
+    STORAGE_KEY_MQTT_BASE,
+    STORAGE_KEY_MQTT_ID,
+    STORAGE_KEY_STA_FAST,
+    STORAGE_KEY_RELAY_STATE,
+    STORAGE_KEY_COUNT
+} StorageKey_t;
+
+// All getters and setters work on a RAM mirror loaded by storage_init().
+// Setters only mark the key dirty, storage_commit() writes every dirty key
+// in one NVS transaction.
 esp_err_t storage_init(void);
-esp_err_t storage_set_str(const char *key, const char *value);
-esp_err_t storage_get_str(const char *key, char *value, size_t length);
+esp_err_t storage_set_str(StorageKey_t key, const char *value);
+esp_err_t storage_get_str(StorageKey_t key, char *value, size_t length);
+esp_err_t storage_set_blob(StorageKey_t key, const void *value, size_t length);
+esp_err_t storage_get_blob(StorageKey_t key, void *value, size_t length);
+esp_err_t storage_set_u32(StorageKey_t key, uint32_t value);
+esp_err_t storage_get_u32(StorageKey_t key, uint32_t *value);
+esp_err_t storage_commit(void);
 esp_err_t storage_erase_all(void);
 
 
-#endif /* STORAGE_MANAGER_H_ */
\ No newline at end of file
+#endif /* STORAGE_MANAGER_H_ */
@@ -1,5 +1,9 @@
 #include "wifi_manager.h"
 
+#include <inttypes.h>
+#include "esp_timer.h"
+#include "metrics.h"
+
 static const char *TAG = "WIFI_MANAGER";
 
 static esp_netif_t *sta_netif = NULL;
@@ -16,13 +20,75 @@ typedef enum
 
 static wifi_state_t wifi_state = WIFI_MODE_NO_INIT;
 
+// Inputs of the STA connection state machine run by vTaskStartStaWifiConnect
+#define STA_EVT_GOT_IP          BIT0
+#define STA_EVT_DISCONNECTED    BIT1
+#define STA_EVT_TIMER           BIT2
+#define STA_EVT_NEW_CREDS       BIT3
+#define STA_EVT_AP_REQUEST      BIT4
+#define STA_EVT_ALL             (STA_EVT_GOT_IP | STA_EVT_DISCONNECTED | STA_EVT_TIMER | \
+                                 STA_EVT_NEW_CREDS | STA_EVT_AP_REQUEST)
+
 static EventGroupHandle_t wifi_event_group;
-const int IP_GOT_IP_BIT = BIT0;
 
+// Holds only the latest submitted credentials, a newer submission replaces an unread one
 static QueueHandle_t wifi_creds_queue = NULL;
 
+// Last good association and DHCP lease, used to skip the scan and DHCP on reconnect
+typedef struct {
+    char ssid[33];
+    uint8_t bssid[6];
+    uint8_t channel;
+    uint32_t ip;
+    uint32_t netmask;
+    uint32_t gw;
+    uint32_t dns;
+} sta_fast_connect_t;
+_Static_assert(sizeof(sta_fast_connect_t) <= STORAGE_VALUE_MAX_LEN, "sta_fast_connect_t does not fit a storage entry");
+
+typedef enum
+{
+    STA_FSM_IDLE = 0,
+    STA_FSM_CONNECTING,     // attempt in progress, timer = attempt timeout
+    STA_FSM_BACKOFF,        // waiting to retry, timer = backoff delay
+    STA_FSM_CONNECTED,
+} sta_fsm_state_t;
+
+typedef struct {
+    sta_fsm_state_t state;
+    wifi_credentials_t creds;
+    sta_fast_connect_t fast;
+    bool fast_path;         // the current attempt uses the cached association
+    bool lease_pending;     // associated on the cached lease, waiting for DHCP to confirm it
+    bool verified;          // these credentials have already produced an IP
+    bool online_once;       // MQTT was started in this STA session
+    bool provisioning;      // testing portal credentials on the STA side of APSTA
+    uint8_t retries;
+} sta_fsm_t;
+
+static sta_fsm_t sta_fsm;
+static esp_timer_handle_t sta_timer = NULL;
+
+// Read by the portal's /status handler while the FSM task updates it
+static wifi_provision_status_t provision_status;
+static portMUX_TYPE provision_spinlock = portMUX_INITIALIZER_UNLOCKED;
+
+static void sta_timer_callback(void *arg)
+{
+    xEventGroupSetBits(wifi_event_group, STA_EVT_TIMER);
+}
+
 static void create_sync_primitives(void)
 {
+    const esp_timer_create_args_t timer_args = {
+        .callback = sta_timer_callback,
+        .name = "sta_fsm",
+    };
+    if (esp_timer_create(&timer_args, &sta_timer) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to create STA timer");
+    }
+
     wifi_event_group = xEventGroupCreate();
     wifi_creds_queue = xQueueCreate(1, sizeof(wifi_credentials_t));
     if (wifi_event_group == NULL || wifi_creds_queue == NULL) 
@@ -42,9 +108,16 @@ static void wifi_event_handler(void *arg, esp_event_base_t event_base,
         }
         else if (event_id == WIFI_EVENT_STA_DISCONNECTED)
         {
-            ESP_LOGI(TAG, "STA_MODE disconnected. Attempting reconnect...");
-            change_blink_time(1000);
-            esp_wifi_connect();
+            wifi_event_sta_disconnected_t *event = (wifi_event_sta_disconnected_t *)event_data;
+            // ASSOC_LEAVE follows our own esp_wifi_disconnect(), the FSM already knows
+            if (event->reason != WIFI_REASON_ASSOC_LEAVE && wifi_event_group)
+            {
+                xEventGroupSetBits(wifi_event_group, STA_EVT_DISCONNECTED);
+            }
+        }
+        else if (event_id == WIFI_EVENT_SCAN_DONE)
+        {
+            wifi_scan_handle_done();
         }
     }
 
@@ -57,7 +130,7 @@ static void wifi_event_handler(void *arg, esp_event_base_t event_base,
 
             if (wifi_event_group)
             {
-                xEventGroupSetBits(wifi_event_group, IP_GOT_IP_BIT);
+                xEventGroupSetBits(wifi_event_group, STA_EVT_GOT_IP);
             }
         }
     }
@@ -79,6 +152,7 @@ static void stop_previos_wifi_mode(void)
 {
     captive_portal_stop();
     dns_responder_stop();
+    wifi_scan_stop_background();
 
     if (wifi_state == WIFI_MODE_AP_ON || wifi_state == WIFI_MODE_STA_ON)
     {
@@ -99,36 +173,93 @@ static void stop_previos_wifi_mode(void)
     wifi_state = WIFI_MODE_NO_INIT;
 }
 
-static bool wait_for_ip_address(uint32_t timeout_ms)
+static void save_wifi_credentials(const char *ssid, const char *pass)
 {
-    if (!wifi_event_group)
-    {
-        ESP_LOGE(TAG, "Wi-Fi event group not created");
+    storage_set_str(STORAGE_KEY_WIFI_SSID, ssid);
+    storage_set_str(STORAGE_KEY_WIFI_PASS, pass);
+}
+
+static bool load_fast_connect(const char *ssid, sta_fast_connect_t *fast)
+{
+    if (storage_get_blob(STORAGE_KEY_STA_FAST, fast, sizeof(*fast)) != ESP_OK)
         return false;
+    fast->ssid[sizeof(fast->ssid) - 1] = 0;
+    return strcmp(fast->ssid, ssid) == 0 && fast->channel != 0 && fast->ip != 0;
+}
+
+static void save_fast_connect(const char *ssid)
+{
+    sta_fast_connect_t fast;
+    wifi_ap_record_t ap_info;
+    esp_netif_ip_info_t ip_info;
+    esp_netif_dns_info_t dns_info;
+
+    if (esp_wifi_sta_get_ap_info(&ap_info) != ESP_OK || esp_netif_get_ip_info(sta_netif, &ip_info) != ESP_OK)
+    {
+        ESP_LOGW(TAG, "Could not read the connection details to cache");
+        return;
     }
-    EventBits_t uxBits = xEventGroupWaitBits(
-        wifi_event_group,
-        IP_GOT_IP_BIT,
-        pdTRUE,
-        pdFALSE,
-        pdMS_TO_TICKS(timeout_ms));
-
-    if ((uxBits & IP_GOT_IP_BIT) != 0)
+    memset(&fast, 0, sizeof(fast));
+    strlcpy(fast.ssid, ssid, sizeof(fast.ssid));
+    memcpy(fast.bssid, ap_info.bssid, sizeof(fast.bssid));
+    fast.channel = ap_info.primary;
+    fast.ip = ip_info.ip.addr;
+    fast.netmask = ip_info.netmask.addr;
+    fast.gw = ip_info.gw.addr;
+    if (esp_netif_get_dns_info(sta_netif, ESP_NETIF_DNS_MAIN, &dns_info) == ESP_OK)
+        fast.dns = dns_info.ip.u_addr.ip4.addr;
+
+    storage_set_blob(STORAGE_KEY_STA_FAST, &fast, sizeof(fast));
+}
+
+// Starts one connection attempt. With `fast` set the scan is limited to the
+// cached AP and channel and the cached lease is applied as a static IP until
+// DHCP, restarted once the link is up, confirms or replaces it.
+static void sta_start_connect(const wifi_credentials_t *creds, const sta_fast_connect_t *fast)
+{
+    wifi_config_t sta_cfg;
+    memset(&sta_cfg, 0, sizeof(sta_cfg));
+    strncpy((char *)sta_cfg.sta.ssid, creds->ssid, sizeof(sta_cfg.sta.ssid) - 1);
+    strncpy((char *)sta_cfg.sta.password, creds->pass, sizeof(sta_cfg.sta.password) - 1);
+
+    if (fast)
     {
-        ESP_LOGI(TAG, "Got IP address within timeout");
-        return true;
+        esp_netif_ip_info_t ip_info = {
+            .ip.addr = fast->ip,
+            .netmask.addr = fast->netmask,
+            .gw.addr = fast->gw,
+        };
+        esp_netif_dhcpc_stop(sta_netif);
+        esp_netif_set_ip_info(sta_netif, &ip_info);
+        if (fast->dns)
+        {
+            esp_netif_dns_info_t dns_info = {0};
+            dns_info.ip.u_addr.ip4.addr = fast->dns;
+            dns_info.ip.type = ESP_IPADDR_TYPE_V4;
+            esp_netif_set_dns_info(sta_netif, ESP_NETIF_DNS_MAIN, &dns_info);
+        }
+
+        sta_cfg.sta.scan_method = WIFI_FAST_SCAN;
+        sta_cfg.sta.bssid_set = true;
+        memcpy(sta_cfg.sta.bssid, fast->bssid, sizeof(sta_cfg.sta.bssid));
+        sta_cfg.sta.channel = fast->channel;
+        ESP_LOGI(TAG, "STA_MODE fast connect on channel %u with cached IP " IPSTR,
+                 fast->channel, IP2STR(&ip_info.ip));
     }
     else
     {
-        ESP_LOGE(TAG, "Timeout waiting for IP address");
-        return false;
+        esp_netif_dhcpc_start(sta_netif);
+        sta_cfg.sta.scan_method = WIFI_ALL_CHANNEL_SCAN;
+        ESP_LOGI(TAG, "STA_MODE wifi_mode will use DHCP (waiting for IP_EVENT_STA_GOT_IP)");
     }
-}
 
-static void save_wifi_credentials(const char *ssid, const char *pass)
-{
-    storage_set_str("ssid", ssid);
-    storage_set_str("pass", pass);
+    xEventGroupClearBits(wifi_event_group, STA_EVT_GOT_IP | STA_EVT_DISCONNECTED);
+    ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &sta_cfg));
+    esp_err_t err = esp_wifi_connect();
+    if (err != ESP_OK)
+    {
+        ESP_LOGW(TAG, "esp_wifi_connect failed: %s", esp_err_to_name(err));
+    }
 }
 
 void wifi_init(void)
@@ -141,12 +272,15 @@ void wifi_init(void)
 
     register_wifi_handlers(); 
     create_sync_primitives();
+    wifi_scan_init();
 }
 
 void start_ap_wifi_mode(void)
 {
     stop_previos_wifi_mode();
     esp_netif_create_default_wifi_ap();
+    // The STA side is only used to scan for networks offered in the portal
+    sta_netif = esp_netif_create_default_wifi_sta();
 
     wifi_config_t ap_config = {
         .ap = {
@@ -160,58 +294,318 @@ void start_ap_wifi_mode(void)
     if (strlen(AP_PASS) == 0)
         ap_config.ap.authmode = WIFI_AUTH_OPEN;
 
-    ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_AP));
+    ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_APSTA));
     ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_AP, &ap_config));
 
     wifi_state = WIFI_MODE_AP_ON;
 }
 
-void vTaskStartStaWifiConnect(void *pvParameter)
+static void enter_ap_mode(void)
 {
-    wifi_credentials_t wifi_credentials;
-    while (1)
+    start_ap_wifi_mode();
+    ESP_ERROR_CHECK(esp_wifi_start());
+    dns_responder_start();
+    captive_portal_start();
+    wifi_scan_start_background();
+    indicator_set_pattern(INDICATE_AP_MODE);
+    mqtt_app_stop();
+    sta_fsm.online_once = false;
+}
+
+static void provision_set_status(ProvisionState_t state, const char *ip)
+{
+    taskENTER_CRITICAL(&provision_spinlock);
+    provision_status.state = state;
+    strlcpy(provision_status.ssid, sta_fsm.creds.ssid, sizeof(provision_status.ssid));
+    strlcpy(provision_status.ip, ip ? ip : "", sizeof(provision_status.ip));
+    taskEXIT_CRITICAL(&provision_spinlock);
+}
+
+void wifi_get_provision_status(wifi_provision_status_t *out)
+{
+    taskENTER_CRITICAL(&provision_spinlock);
+    *out = provision_status;
+    taskEXIT_CRITICAL(&provision_spinlock);
+}
+
+// Credentials submitted in AP mode are tried on the STA side while the AP,
+// DNS responder and portal stay up, so the browser can follow the result
+static void provision_begin(void)
+{
+    wifi_scan_stop_background();
+    sta_fsm.provisioning = true;
+    provision_set_status(PROVISION_CONNECTING, NULL);
+}
+
+static void provision_fail(void)
+{
+    ESP_LOGW(TAG, "Provisioning of SSID '%s' failed, staying in AP mode", sta_fsm.creds.ssid);
+    sta_fsm.provisioning = false;
+    provision_set_status(PROVISION_FAILED, NULL);
+    mqtt_app_stop();
+    sta_fsm.online_once = false;
+    wifi_scan_start_background();
+    indicator_set_pattern(INDICATE_AP_MODE);
+}
+
+static void provision_abort(void)
+{
+    if (!sta_fsm.provisioning)
+        return;
+    sta_fsm.provisioning = false;
+    provision_set_status(PROVISION_IDLE, NULL);
+    wifi_scan_start_background();
+}
+
+// Runs once the browser has had time to read the result: drops the AP side
+// and leaves the STA connection untouched
+static void provision_finish(void)
+{
+    ESP_LOGI(TAG, "Provisioning done, shutting down AP");
+    sta_fsm.provisioning = false;
+    captive_portal_stop();
+    dns_responder_stop();
+    ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
+
+    esp_netif_t *ap_netif = esp_netif_get_handle_from_ifkey("WIFI_AP_DEF");
+    if (ap_netif)
     {
-        if (xQueueReceive(wifi_creds_queue, &wifi_credentials, portMAX_DELAY) == pdTRUE)
-        {
-            ESP_LOGI(TAG, "Received credentials from queue: SSID: '%s'", wifi_credentials.ssid);
+        esp_netif_destroy(ap_netif);
+    }
+    wifi_state = WIFI_MODE_STA_ON;
+}
+
+static void sta_timer_arm(uint32_t timeout_ms)
+{
+    esp_timer_stop(sta_timer);
+    xEventGroupClearBits(wifi_event_group, STA_EVT_TIMER);
+    esp_timer_start_once(sta_timer, timeout_ms * 1000ULL);
+}
+
+// Exponential backoff with "equal jitter": half the step is fixed, half random
+static uint32_t sta_backoff_ms(uint8_t retry)
+{
+    uint32_t step = STA_BACKOFF_MAX_MS;
+    if (retry < 16 && (STA_BACKOFF_BASE_MS << retry) < STA_BACKOFF_MAX_MS)
+        step = STA_BACKOFF_BASE_MS << retry;
+    return step / 2 + esp_random() % (step / 2 + 1);
+}
+
+static void sta_fsm_attempt(void)
+{
+    sta_fsm.lease_pending = false;
+    metrics_inc(METRIC_WIFI_ATTEMPTS);
+    sta_start_connect(&sta_fsm.creds, sta_fsm.fast_path ? &sta_fsm.fast : NULL);
+    sta_timer_arm(sta_fsm.fast_path ? STA_FAST_CONNECT_TIMEOUT_MS : STA_CONNECT_TIMEOUT_MS);
+    sta_fsm.state = STA_FSM_CONNECTING;
+}
+
+static void sta_fsm_cancel(void)
+{
+    esp_timer_stop(sta_timer);
+    if (sta_fsm.state == STA_FSM_CONNECTING || sta_fsm.state == STA_FSM_CONNECTED)
+    {
+        esp_wifi_disconnect();
+    }
+    sta_fsm.state = STA_FSM_IDLE;
+}
 
-            stop_previos_wifi_mode();
-            sta_netif = esp_netif_create_default_wifi_sta();
+static bool sta_creds_are_saved(const wifi_credentials_t *creds)
+{
+    wifi_credentials_t saved;
+    return storage_get_str(STORAGE_KEY_WIFI_SSID, saved.ssid, sizeof(saved.ssid)) == ESP_OK &&
+           storage_get_str(STORAGE_KEY_WIFI_PASS, saved.pass, sizeof(saved.pass)) == ESP_OK &&
+           strcmp(saved.ssid, creds->ssid) == 0 && strcmp(saved.pass, creds->pass) == 0;
+}
 
-            ESP_LOGI(TAG, "STA_MODE wifi_mode will use DHCP (waiting for IP_EVENT_STA_GOT_IP)");
+static void sta_fsm_on_new_creds(void)
+{
+    if (xQueueReceive(wifi_creds_queue, &sta_fsm.creds, 0) != pdTRUE)
+        return;
 
-            wifi_config_t sta_cfg;
-            memset(&sta_cfg, 0, sizeof(sta_cfg));
-            strncpy((char *)sta_cfg.sta.ssid, wifi_credentials.ssid, sizeof(sta_cfg.sta.ssid) - 1);
-            strncpy((char *)sta_cfg.sta.password, wifi_credentials.pass, sizeof(sta_cfg.sta.password) - 1);
+    ESP_LOGI(TAG, "Received credentials from queue: SSID: '%s'", sta_fsm.creds.ssid);
+    sta_fsm_cancel();
 
-            ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
-            ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &sta_cfg));
-            ESP_ERROR_CHECK(esp_wifi_start());
-            ESP_ERROR_CHECK(esp_wifi_connect());
+    if (wifi_state == WIFI_MODE_AP_ON)
+    {
+        provision_begin();
+    }
+    else if (wifi_state != WIFI_MODE_STA_ON)
+    {
+        stop_previos_wifi_mode();
+        mqtt_app_stop();
+        sta_netif = esp_netif_create_default_wifi_sta();
+        ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
+        ESP_ERROR_CHECK(esp_wifi_start());
+        wifi_state = WIFI_MODE_STA_ON;
+        sta_fsm.online_once = false;
+    }
 
-            bool ip_ok = wait_for_ip_address(20000);
+    sta_fsm.verified = sta_creds_are_saved(&sta_fsm.creds);
+    sta_fsm.fast_path = load_fast_connect(sta_fsm.creds.ssid, &sta_fsm.fast);
+    sta_fsm.retries = 0;
+    sta_fsm_attempt();
+}
 
-            if (ip_ok)
-            {
-                captive_portal_stop();
-                dns_responder_stop();
-                change_blink_time(portMAX_DELAY);
-                mqtt_app_start();
+// The static cached lease only marks the association. It may have expired or
+// belong to another subnet, so DHCP (which asks for the same address again)
+// has to confirm it before the attempt counts; the timeout falls back to a full
+// connect like any failed fast attempt.
+static void sta_fsm_on_fast_associated(void)
+{
+    sta_fsm.lease_pending = true;
+    esp_netif_dhcpc_start(sta_netif);
+    sta_timer_arm(STA_FAST_LEASE_TIMEOUT_MS);
+}
 
-                save_wifi_credentials(wifi_credentials.ssid, wifi_credentials.pass);
-                wifi_state = WIFI_MODE_STA_ON;
-            }
-            else
-            {
-                ESP_LOGE(TAG, "Failed to connect to SSID: '%s'", wifi_credentials.ssid);
-                start_ap_wifi_mode();
-                ESP_ERROR_CHECK(esp_wifi_start());
-                dns_responder_start();
-                captive_portal_start();
-                change_blink_time(400);
-                mqtt_app_stop();
-            }
+static void sta_fsm_on_got_ip(void)
+{
+    esp_timer_stop(sta_timer);
+    sta_fsm.state = STA_FSM_CONNECTED;
+    sta_fsm.lease_pending = false;
+    sta_fsm.retries = 0;
+
+    // The lease DHCP confirmed may differ from the cached one
+    save_fast_connect(sta_fsm.creds.ssid);
+    if (!sta_fsm.verified)
+    {
+        save_wifi_credentials(sta_fsm.creds.ssid, sta_fsm.creds.pass);
+        sta_fsm.verified = true;
+    }
+    storage_commit();
+
+    if (sta_fsm.provisioning)
+    {
+        esp_netif_ip_info_t ip_info;
+        char ip[16] = "";
+        if (esp_netif_get_ip_info(sta_netif, &ip_info) == ESP_OK)
+            snprintf(ip, sizeof(ip), IPSTR, IP2STR(&ip_info.ip));
+        provision_set_status(PROVISION_CONNECTED, ip);
+        sta_timer_arm(PROVISION_AP_LINGER_MS);
+    }
+
+    if (!sta_fsm.online_once)
+    {
+        ESP_LOGI(TAG, "Boot to IP: %" PRId64 " ms (%s path)",
+                 esp_timer_get_time() / 1000, sta_fsm.fast_path ? "fast" : "full");
+        indicator_set_pattern(INDICATE_MQTT_DOWN);
+        mqtt_app_start();
+        sta_fsm.online_once = true;
+    }
+    else
+    {
+        // MQTT reconnects on its own and switches the LED to solid when it does
+        indicator_replace_pattern(INDICATE_WIFI_DOWN, INDICATE_MQTT_DOWN);
+    }
+}
+
+// Called when an attempt ends without an IP, or when an established link drops
+static void sta_fsm_on_failure(void)
+{
+    if (sta_fsm.fast_path)
+    {
+        ESP_LOGW(TAG, "Fast connect failed, falling back to full scan and DHCP");
+        sta_fsm.fast_path = false;
+        sta_fsm_attempt();
+        return;
+    }
+
+    uint8_t max_retries = sta_fsm.verified ? STA_MAX_RETRIES : STA_MAX_RETRIES_UNVERIFIED;
+    bool retry_forever = sta_fsm.verified && !sta_fsm.provisioning;
+    if (!retry_forever && sta_fsm.retries >= max_retries)
+    {
+        ESP_LOGE(TAG, "Failed to connect to SSID: '%s' after %u retries", sta_fsm.creds.ssid, sta_fsm.retries);
+        sta_fsm.state = STA_FSM_IDLE;
+        if (sta_fsm.provisioning)
+            provision_fail();
+        else
+            enter_ap_mode();
+        return;
+    }
+
+    uint32_t delay_ms = sta_backoff_ms(sta_fsm.retries);
+    if (sta_fsm.retries < UINT8_MAX)
+        sta_fsm.retries++;
+    if (retry_forever)
+        ESP_LOGI(TAG, "STA_MODE retry %u in %" PRIu32 " ms", sta_fsm.retries, delay_ms);
+    else
+        ESP_LOGI(TAG, "STA_MODE retry %u/%u in %" PRIu32 " ms", sta_fsm.retries, max_retries, delay_ms);
+    sta_timer_arm(delay_ms);
+    sta_fsm.state = STA_FSM_BACKOFF;
+}
+
+static void sta_fsm_on_disconnected(void)
+{
+    if (sta_fsm.state == STA_FSM_CONNECTED)
+    {
+        ESP_LOGI(TAG, "STA_MODE disconnected. Attempting reconnect...");
+        metrics_inc(METRIC_WIFI_DISCONNECTS);
+        indicator_set_pattern(INDICATE_WIFI_DOWN);
+        // Reconnects go through a normal scan and DHCP, with backoff from the first retry
+        sta_fsm.fast_path = false;
+        sta_fsm.state = STA_FSM_CONNECTING;
+        sta_fsm_on_failure();
+    }
+    else if (sta_fsm.state == STA_FSM_CONNECTING)
+    {
+        esp_timer_stop(sta_timer);
+        sta_fsm_on_failure();
+    }
+}
+
+static void sta_fsm_on_timer(void)
+{
+    if (sta_fsm.state == STA_FSM_CONNECTING)
+    {
+        ESP_LOGW(TAG, "Timeout waiting for IP address");
+        esp_wifi_disconnect();
+        sta_fsm_on_failure();
+    }
+    else if (sta_fsm.state == STA_FSM_BACKOFF)
+    {
+        sta_fsm_attempt();
+    }
+    else if (sta_fsm.state == STA_FSM_CONNECTED && sta_fsm.provisioning)
+    {
+        provision_finish();
+    }
+}
+
+void vTaskStartStaWifiConnect(void *pvParameter)
+{
+    while (1)
+    {
+        EventBits_t bits = xEventGroupWaitBits(wifi_event_group, STA_EVT_ALL, pdTRUE, pdFALSE, portMAX_DELAY);
+
+        if (bits & STA_EVT_AP_REQUEST)
+        {
+            sta_fsm_cancel();
+            provision_abort();
+            if (wifi_state != WIFI_MODE_AP_ON)
+                enter_ap_mode();
+        }
+        if (bits & STA_EVT_NEW_CREDS)
+        {
+            // Link events collected before the new attempt belong to the old one
+            sta_fsm_on_new_creds();
+            continue;
+        }
+        // A link that drops right after DHCP delivers both bits in one wake,
+        // the order they happened in is GOT_IP first
+        if (bits & STA_EVT_GOT_IP)
+        {
+            if (sta_fsm.state == STA_FSM_CONNECTING && sta_fsm.fast_path && !sta_fsm.lease_pending)
+                sta_fsm_on_fast_associated();
+            else if (sta_fsm.state == STA_FSM_CONNECTING)
+                sta_fsm_on_got_ip();
+        }
+        if (bits & STA_EVT_DISCONNECTED)
+        {
+            sta_fsm_on_disconnected();
+        }
+        if (bits & STA_EVT_TIMER)
+        {
+            sta_fsm_on_timer();
         }
     }
 }
@@ -221,32 +615,24 @@ void change_wifi_mode(WiFiModeState_t wifi_mode, wifi_credentials_t *creds_opt)
     switch (wifi_mode)
     {
     case AP_MODE:
-        if (wifi_state != WIFI_MODE_AP_ON) 
-        {
-            start_ap_wifi_mode(); 
-            ESP_ERROR_CHECK(esp_wifi_start());
-            dns_responder_start();
-            captive_portal_start();
-            change_blink_time(400);
-            mqtt_app_stop();
-        }
+        xEventGroupSetBits(wifi_event_group, STA_EVT_AP_REQUEST);
         break;
     case STA_MODE:
-        if (wifi_state != WIFI_MODE_STA_ON) 
+        if (creds_opt == NULL)
         {
-            if (xQueueSend(wifi_creds_queue, creds_opt, 0) != pdPASS) 
-            {
-                ESP_LOGE(TAG, "Failed to send credentials to queue.");
-            }
+            ESP_LOGE(TAG, "STA_MODE requested without credentials");
+            break;
         }
+        xQueueOverwrite(wifi_creds_queue, creds_opt);
+        xEventGroupSetBits(wifi_event_group, STA_EVT_NEW_CREDS);
         break;
     }
 }
 
 static WiFiModeState_t storage_has_credentials(wifi_credentials_t *creds_opt)
 {
-    esp_err_t ssid_err = storage_get_str("ssid", creds_opt->ssid, sizeof(creds_opt->ssid));
-    esp_err_t pass_err = storage_get_str("pass", creds_opt->pass, sizeof(creds_opt->pass));
+    esp_err_t ssid_err = storage_get_str(STORAGE_KEY_WIFI_SSID, creds_opt->ssid, sizeof(creds_opt->ssid));
+    esp_err_t pass_err = storage_get_str(STORAGE_KEY_WIFI_PASS, creds_opt->pass, sizeof(creds_opt->pass));
     if (ssid_err == ESP_OK && pass_err == ESP_OK && strlen(creds_opt->ssid) > 0 && strlen(creds_opt->pass) > 0) 
     {
         return STA_MODE;
@@ -7,6 +7,7 @@
 #include "captive_portal.h"
 #include "storage_manager.h"
 #include "mqtt.h"
+#include "wifi_scan.h"
 
 #include "esp_system.h"
 #include "esp_event.h"
@@ -24,6 +25,19 @@
 #define AP_CHANNEL          1
 #define AP_MAX_CONN         4
 
+#define STA_CONNECT_TIMEOUT_MS      20000
+#define STA_FAST_CONNECT_TIMEOUT_MS 5000
+#define STA_FAST_LEASE_TIMEOUT_MS   10000   // DHCP must confirm the cached lease within this
+
+#define STA_BACKOFF_BASE_MS         1000
+#define STA_BACKOFF_MAX_MS          60000
+// A saved network that has worked before is retried forever at the backoff cap,
+// the reset button is the way back to AP mode
+#define STA_MAX_RETRIES             8   // known network tested again from the portal
+#define STA_MAX_RETRIES_UNVERIFIED  2   // fresh portal credentials, get back to AP quickly
+
+#define PROVISION_AP_LINGER_MS      10000   // AP stays up this long after a successful test
+
 typedef enum {
     AP_MODE = 0,
     STA_MODE = 1
@@ -34,10 +48,24 @@ typedef struct {
     char pass[64];
 } wifi_credentials_t;
 
+typedef enum {
+    PROVISION_IDLE = 0,
+    PROVISION_CONNECTING,
+    PROVISION_CONNECTED,
+    PROVISION_FAILED
+} ProvisionState_t;
+
+typedef struct {
+    ProvisionState_t state;
+    char ssid[33];
+    char ip[16];
+} wifi_provision_status_t;
+
 void wifi_init(void);
 void vTaskStartStaWifiConnect(void *pvParameter);
 void change_wifi_mode(WiFiModeState_t wifi_mode, wifi_credentials_t *creds_opt);
 void launch_wifi_saved_mode(void);
+void wifi_get_provision_status(wifi_provision_status_t *out);
 
 
 #endif /* WIFI_MANAGER_H_ */
@@ -0,0 +1,167 @@
+#include "wifi_scan.h"
+
+#include <string.h>
+#include <stdbool.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include "freertos/FreeRTOS.h"
+
+static const char *TAG = "WIFI_SCAN";
+
+static esp_timer_handle_t scan_timer = NULL;
+static portMUX_TYPE scan_spinlock = portMUX_INITIALIZER_UNLOCKED;
+
+static bool scan_background = false;
+static bool scan_in_progress = false;
+
+// The cache is only touched under scan_spinlock. The staging buffers are only
+// used from the event loop task that handles WIFI_EVENT_SCAN_DONE.
+static wifi_scan_entry_t scan_cache[WIFI_SCAN_MAX_RESULTS];
+static size_t scan_cache_count = 0;
+static int64_t scan_cache_time_us = 0;
+
+static wifi_ap_record_t scan_records[WIFI_SCAN_MAX_RESULTS];
+static wifi_scan_entry_t scan_fresh[WIFI_SCAN_MAX_RESULTS];
+
+static void scan_timer_callback(void *arg)
+{
+    wifi_scan_request();
+}
+
+void wifi_scan_init(void)
+{
+    const esp_timer_create_args_t timer_args = {
+        .callback = scan_timer_callback,
+        .name = "wifi_scan",
+    };
+
+    if (esp_timer_create(&timer_args, &scan_timer) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to create scan timer");
+    }
+}
+
+void wifi_scan_request(void)
+{
+    // Short active dwell per channel keeps the AP off its channel only briefly
+    wifi_scan_config_t scan_cfg = {
+        .show_hidden = false,
+        .scan_type = WIFI_SCAN_TYPE_ACTIVE,
+        .scan_time.active.min = 50,
+        .scan_time.active.max = 120,
+    };
+
+    taskENTER_CRITICAL(&scan_spinlock);
+    bool start = scan_background && !scan_in_progress;
+    if (start)
+        scan_in_progress = true;
+    taskEXIT_CRITICAL(&scan_spinlock);
+
+    if (!start)
+        return;
+
+    esp_err_t err = esp_wifi_scan_start(&scan_cfg, false);
+    if (err != ESP_OK)
+    {
+        ESP_LOGW(TAG, "Scan start failed: %s", esp_err_to_name(err));
+        taskENTER_CRITICAL(&scan_spinlock);
+        scan_in_progress = false;
+        taskEXIT_CRITICAL(&scan_spinlock);
+    }
+}
+
+void wifi_scan_start_background(void)
+{
+    taskENTER_CRITICAL(&scan_spinlock);
+    scan_background = true;
+    taskEXIT_CRITICAL(&scan_spinlock);
+
+    if (scan_timer)
+    {
+        esp_timer_stop(scan_timer);
+        esp_timer_start_periodic(scan_timer, WIFI_SCAN_INTERVAL_MS * 1000ULL);
+    }
+    wifi_scan_request();
+}
+
+void wifi_scan_stop_background(void)
+{
+    taskENTER_CRITICAL(&scan_spinlock);
+    bool was_scanning = scan_in_progress;
+    scan_background = false;
+    scan_in_progress = false;
+    taskEXIT_CRITICAL(&scan_spinlock);
+
+    if (scan_timer)
+        esp_timer_stop(scan_timer);
+    if (was_scanning)
+        esp_wifi_scan_stop();
+}
+
+static bool scan_has_ssid(const wifi_scan_entry_t *entries, size_t count, const char *ssid)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        if (strcmp(entries[i].ssid, ssid) == 0)
+            return true;
+    }
+    return false;
+}
+
+void wifi_scan_handle_done(void)
+{
+    taskENTER_CRITICAL(&scan_spinlock);
+    bool expected = scan_in_progress;
+    scan_in_progress = false;
+    taskEXIT_CRITICAL(&scan_spinlock);
+
+    // Reading the records also frees the driver's copy, do it even if nobody waits
+    uint16_t number = WIFI_SCAN_MAX_RESULTS;
+    if (esp_wifi_scan_get_ap_records(&number, scan_records) != ESP_OK || !expected)
+        return;
+
+    // Records come sorted by RSSI, so the first occurrence of an SSID is the strongest
+    size_t count = 0;
+    for (uint16_t i = 0; i < number; i++)
+    {
+        const char *ssid = (const char *)scan_records[i].ssid;
+        if (ssid[0] == 0 || scan_has_ssid(scan_fresh, count, ssid))
+            continue;
+
+        wifi_scan_entry_t *entry = &scan_fresh[count++];
+        strlcpy(entry->ssid, ssid, sizeof(entry->ssid));
+        entry->rssi = scan_records[i].rssi;
+        entry->authmode = scan_records[i].authmode;
+        entry->channel = scan_records[i].primary;
+    }
+
+    taskENTER_CRITICAL(&scan_spinlock);
+    memcpy(scan_cache, scan_fresh, count * sizeof(wifi_scan_entry_t));
+    scan_cache_count = count;
+    scan_cache_time_us = esp_timer_get_time();
+    taskEXIT_CRITICAL(&scan_spinlock);
+
+    ESP_LOGI(TAG, "Scan done, %u networks cached", (unsigned)count);
+}
+
+size_t wifi_scan_get_results(wifi_scan_entry_t *out, size_t max_entries)
+{
+    int64_t now = esp_timer_get_time();
+    size_t count = 0;
+
+    taskENTER_CRITICAL(&scan_spinlock);
+    if (scan_cache_time_us != 0 && now - scan_cache_time_us <= WIFI_SCAN_MAX_AGE_MS * 1000LL)
+    {
+        count = scan_cache_count < max_entries ? scan_cache_count : max_entries;
+        memcpy(out, scan_cache, count * sizeof(wifi_scan_entry_t));
+    }
+    else
+    {
+        scan_cache_count = 0;
+    }
+    taskEXIT_CRITICAL(&scan_spinlock);
+
+    return count;
+}
@@ -0,0 +1,25 @@
+#ifndef WIFI_SCAN_H_
+#define WIFI_SCAN_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define WIFI_SCAN_MAX_RESULTS   16
+#define WIFI_SCAN_INTERVAL_MS   30000
+#define WIFI_SCAN_MAX_AGE_MS    90000
+
+typedef struct {
+    char ssid[33];
+    int8_t rssi;
+    uint8_t authmode;
+    uint8_t channel;
+} wifi_scan_entry_t;
+
+void wifi_scan_init(void);
+void wifi_scan_start_background(void);
+void wifi_scan_stop_background(void);
+void wifi_scan_request(void);
+void wifi_scan_handle_done(void);
+size_t wifi_scan_get_results(wifi_scan_entry_t *out, size_t max_entries);
+
+#endif /* WIFI_SCAN_H_ */
@@ -0,0 +1,247 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "parse.h"
+
+/*
+ * Before/after timing of the MQTT command parser and of the state JSON
+ * builder. The streaming parser is
+ * always measured; when cJSON is found at configure time the cJSON-tree
+ * parser it replaced is built from the copy below and measured on the same
+ * "states" payloads, and both must agree on the resulting state. The
+ * malformed set is not timed; both parsers must reject every entry.
+ * build_mqtt_state_json() is timed over the state sweep below and, with
+ * cJSON, against the cJSON_PrintUnformatted() builder it replaced; both must
+ * produce the same bytes. Built once per channel count (bench_parse for 3,
+ * bench_parse_n32 for 32).
+ *   ./bench_parse [iterations]
+ */
+
+#define BENCH_DEFAULT_ITERATIONS    200000
+#define BENCH_JSON_BUF_LEN          512
+// Every state up to 2^20 of them; above that an odd stride walks the full
+// 32-bit range in as many steps, hitting every 4-channel fragment
+#define BENCH_STATE_SWEEP           (1UL << 20)
+
+static const char *const payloads[] = {
+    "{\"states\":[\"ON\",\"OFF\",\"ON\"]}",
+    "{ \"states\" : [ \"OFF\" , \"OFF\" , \"OFF\" ] }",
+    "{\"device\":\"living\",\"seq\":1234,\"states\":[\"ON\",\"ON\",\"OFF\"],\"meta\":{\"src\":\"ha\"}}",
+};
+
+// Invalid JSON that cJSON_Parse() refuses, so the streaming parser must refuse it too
+static const char *const malformed[] = {
+    "{\"x\":abc,\"states\":[\"ON\",\"ON\",\"ON\"]}",
+    "{\"states\":[\"ON\",bogus]}",
+    "{\"states\":[\"ON\",tru]}",
+    "{\"states\":[nul,\"ON\"]}",
+    "{\"states\":[truex,\"ON\"]}",
+    "{\"states\":[-,\"ON\"]}",
+    "{\"states\":[+1,\"ON\"]}",
+    "{\"states\":[.5,\"ON\"]}",
+    "{\"states\":[1e,\"ON\"]}",
+    "{\"states\":[\"ON\"],\"x\":Null}",
+    "{\"states\":[\"ON\",\"OFF\"",
+    "{\"states\":[\"ON\",]}",
+};
+
+#if HOST_BENCH_LEGACY
+#include "cJSON.h"
+
+// parse_mqtt_state_json() as it was before the streaming parser
+static esp_err_t legacy_parse_states(const char *json_data, uint8_t *out_state)
+{
+    cJSON *root = cJSON_Parse(json_data);
+    if (!root)
+        return ESP_FAIL;
+
+    cJSON *arr = cJSON_GetObjectItem(root, "states");
+    if (!cJSON_IsArray(arr))
+    {
+        cJSON_Delete(root);
+        return ESP_FAIL;
+    }
+
+    uint32_t arr_size = cJSON_GetArraySize(arr);
+    uint8_t state = 0;
+    for (uint8_t i = 0; i < arr_size && i < COUNT_BUTTONS; i++)
+    {
+        cJSON *curr_item = cJSON_GetArrayItem(arr, i);
+        if (curr_item && cJSON_IsString(curr_item) && curr_item->valuestring && !strcmp(curr_item->valuestring, "ON"))
+            state |= (1 << i);
+    }
+    *out_state = state;
+    cJSON_Delete(root);
+    return ESP_OK;
+}
+
+// build_mqtt_state_json() as it was before the fragment table, widened to uint32_t
+static esp_err_t legacy_build_state_json(char *json_buf, size_t buf_size, uint32_t state)
+{
+    cJSON *root = cJSON_CreateObject();
+    if (!root)
+        return ESP_FAIL;
+    cJSON *arr = cJSON_CreateArray();
+    if (!arr)
+    {
+        cJSON_Delete(root);
+        return ESP_FAIL;
+    }
+
+    for (uint8_t i = 0; i < COUNT_BUTTONS; i++)
+    {
+        cJSON_AddItemToArray(arr, cJSON_CreateString((state & (1UL << i)) ? "ON" : "OFF"));
+    }
+    cJSON_AddItemToObject(root, "states", arr);
+
+    char *out = cJSON_PrintUnformatted(root);
+    if (!out)
+    {
+        cJSON_Delete(root);
+        return ESP_FAIL;
+    }
+    if (strlen(out) >= buf_size)
+    {
+        cJSON_free(out);
+        cJSON_Delete(root);
+        return ESP_ERR_NO_MEM;
+    }
+    strcpy(json_buf, out);
+    cJSON_free(out);
+    cJSON_Delete(root);
+    return ESP_OK;
+}
+#endif
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static uint32_t sweep_count(void)
+{
+    return LED_STATE_MASK < BENCH_STATE_SWEEP ? LED_STATE_MASK + 1 : BENCH_STATE_SWEEP;
+}
+
+static uint32_t sweep_state(uint32_t i)
+{
+    return LED_STATE_MASK < BENCH_STATE_SWEEP ? i : (i * 0x9E3779B1u) & LED_STATE_MASK;
+}
+
+static int bench_state_json(long iterations)
+{
+    char buf[BENCH_JSON_BUF_LEN];
+    volatile size_t sink = 0;
+    uint32_t count = sweep_count();
+    // Small channel counts go round the sweep until the iteration count is reached
+    long ops = iterations > (long)count ? iterations : (long)count;
+    int mismatches = 0;
+
+    parse_init();
+    double start = now_ns();
+    for (long i = 0; i < ops; i++)
+    {
+        size_t len = 0;
+        build_mqtt_state_json(buf, sizeof(buf), sweep_state(i % count), &len);
+        sink += len;
+    }
+    printf("%-10s %-8s %12.1f  (N=%d, %lu states)\n", "table", "state", (now_ns() - start) / ops,
+           COUNT_BUTTONS, (unsigned long)count);
+
+#if HOST_BENCH_LEGACY
+    start = now_ns();
+    for (long i = 0; i < ops; i++)
+    {
+        legacy_build_state_json(buf, sizeof(buf), sweep_state(i % count));
+        sink += buf[0];
+    }
+    printf("%-10s %-8s %12.1f  (N=%d, %lu states)\n", "cjson", "state", (now_ns() - start) / ops,
+           COUNT_BUTTONS, (unsigned long)count);
+
+    char legacy[BENCH_JSON_BUF_LEN];
+    for (uint32_t i = 0; i < count; i++)
+    {
+        uint32_t state = sweep_state(i);
+        if (build_mqtt_state_json(buf, sizeof(buf), state, NULL) != ESP_OK ||
+            legacy_build_state_json(legacy, sizeof(legacy), state) != ESP_OK || strcmp(buf, legacy) != 0)
+        {
+            fprintf(stderr, "state 0x%08x: table '%s', cJSON '%s'\n", (unsigned)state, buf, legacy);
+            if (++mismatches > 10)
+                break;
+        }
+    }
+#endif
+    return mismatches;
+}
+
+int main(int argc, char **argv)
+{
+    long iterations = argc > 1 ? atol(argv[1]) : BENCH_DEFAULT_ITERATIONS;
+    volatile uint32_t sink = 0;
+    int mismatches = 0;
+
+    printf("%-10s %-8s %12s\n", "parser", "payload", "ns/op");
+    for (size_t p = 0; p < sizeof(payloads) / sizeof(payloads[0]); p++)
+    {
+        const char *json = payloads[p];
+        size_t len = strlen(json);
+        led_command_t cmd = {0};
+
+        double start = now_ns();
+        for (long i = 0; i < iterations; i++)
+        {
+            parse_mqtt_command_json(json, len, LED_STATE_MASK, &cmd);
+            sink += cmd.mask;
+        }
+        printf("%-10s %-8zu %12.1f\n", "streaming", p, (now_ns() - start) / iterations);
+
+#if HOST_BENCH_LEGACY
+        uint8_t state = 0;
+        start = now_ns();
+        for (long i = 0; i < iterations; i++)
+        {
+            legacy_parse_states(json, &state);
+            sink += state;
+        }
+        printf("%-10s %-8zu %12.1f\n", "cjson", p, (now_ns() - start) / iterations);
+
+        if (cmd.op != LED_CMD_ASSIGN || cmd.mask != state)
+        {
+            fprintf(stderr, "payload %zu: streaming 0x%x, cJSON 0x%x\n", p, (unsigned)cmd.mask, state);
+            mismatches++;
+        }
+#endif
+    }
+
+    for (size_t p = 0; p < sizeof(malformed) / sizeof(malformed[0]); p++)
+    {
+        led_command_t cmd = {0};
+        esp_err_t err = parse_mqtt_command_json(malformed[p], strlen(malformed[p]), LED_STATE_MASK, &cmd);
+        if (err != ESP_FAIL)
+        {
+            fprintf(stderr, "malformed %zu '%s': streaming returned %d\n", p, malformed[p], err);
+            mismatches++;
+        }
+#if HOST_BENCH_LEGACY
+        uint8_t state = 0;
+        esp_err_t legacy_err = legacy_parse_states(malformed[p], &state);
+        if (legacy_err != err)
+        {
+            fprintf(stderr, "malformed %zu '%s': streaming %d, cJSON %d\n", p, malformed[p], err, legacy_err);
+            mismatches++;
+        }
+#endif
+    }
+    printf("malformed: %zu payloads checked, %d mismatch(es)\n", sizeof(malformed) / sizeof(malformed[0]), mismatches);
+
+
+    mismatches += bench_state_json(iterations);
+
+#if !HOST_BENCH_LEGACY
+    printf("cJSON not found at configure time, only the new code was measured\n");
+#endif
+    return mismatches ? 1 : 0;
+}
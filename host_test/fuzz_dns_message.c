@@ -0,0 +1,120 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dns_message.h"
+
+/*
+ * Fuzz target for dns_build_response(). Built with clang and
+ * -DHOST_TEST_FUZZ=ON it links against libFuzzer; otherwise main() below
+ * replays a built-in seed set, deterministic mutations of it and any files
+ * given on the command line, so the same target runs under ASan in ctest.
+ */
+
+#define FUZZ_CAP_SLACK  (DNS_MAX_ANSWERS * DNS_ANSWER_SIZE)
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    // First byte picks how much room is left for answers, the rest is the query
+    if (size == 0)
+        return 0;
+    size_t slack = data[0] % (FUZZ_CAP_SLACK + 1);
+    size--;
+    data++;
+
+    size_t cap = size + slack;
+    uint8_t *buf = malloc(cap ? cap : 1);
+    memcpy(buf, data, size);
+
+    size_t len = dns_build_response(buf, size, cap);
+    if (len > cap || (len != 0 && len < DNS_HEADER_SIZE))
+        abort();
+
+    free(buf);
+    return 0;
+}
+
+#ifndef HOST_TEST_LIBFUZZER
+
+#define FUZZ_MUTATIONS  200000
+
+static const uint8_t seeds[][48] = {
+    // slack, header, example.com A
+    {64, 0x12, 0x34, 0x01, 0x00, 0, 1, 0, 0, 0, 0, 0, 0,
+     7, 'e', 'x', 'a', 'm', 'p', 'l', 'e', 3, 'c', 'o', 'm', 0, 0, 1, 0, 1},
+    // two questions, the second compressed
+    {64, 0x00, 0x02, 0x01, 0x00, 0, 2, 0, 0, 0, 0, 0, 0,
+     1, 'a', 0, 0, 1, 0, 1, 0xC0, 12, 0, 255, 0, 1},
+    // AAAA with an EDNS OPT record
+    {16, 0x00, 0x03, 0x01, 0x00, 0, 1, 0, 0, 0, 0, 0, 1,
+     1, 'b', 0, 0, 28, 0, 1, 0, 0, 41, 0x10, 0, 0, 0, 0, 0, 0, 0},
+    // pointer loop and a huge QDCOUNT
+    {0, 0x00, 0x04, 0x01, 0x00, 0xFF, 0xFF, 0, 0, 0, 0, 0, 0, 0xC0, 12, 0, 1, 0, 1},
+};
+
+static uint32_t rng_state = 0x2545F491;
+
+static uint32_t rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static int replay_file(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f)
+    {
+        perror(path);
+        return 1;
+    }
+    uint8_t data[1024];
+    size_t size = fread(data, 1, sizeof(data), f);
+    fclose(f);
+    LLVMFuzzerTestOneInput(data, size);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1)
+    {
+        int failed = 0;
+        for (int i = 1; i < argc; i++)
+            failed |= replay_file(argv[i]);
+        return failed;
+    }
+
+    dns_message_init(0x0104A8C0);
+
+    for (size_t i = 0; i < sizeof(seeds) / sizeof(seeds[0]); i++)
+        LLVMFuzzerTestOneInput(seeds[i], sizeof(seeds[i]));
+
+    // Byte flips, truncation and growth of the seeds, including oversized queries
+    uint8_t data[600];
+    for (uint32_t n = 0; n < FUZZ_MUTATIONS; n++)
+    {
+        const uint8_t *seed = seeds[rng() % (sizeof(seeds) / sizeof(seeds[0]))];
+        size_t size = sizeof(seeds[0]);
+        memcpy(data, seed, size);
+
+        if (rng() % 4 == 0)
+        {
+            size_t grow = rng() % (sizeof(data) - size);
+            for (size_t i = 0; i < grow; i++)
+                data[size + i] = rng();
+            size += grow;
+        }
+        for (uint32_t flips = rng() % 8; flips; flips--)
+            data[rng() % size] = rng();
+        if (rng() % 3 == 0)
+            size = rng() % (size + 1);
+
+        LLVMFuzzerTestOneInput(data, size);
+    }
+    printf("%d mutated queries replayed\n", FUZZ_MUTATIONS);
+    return 0;
+}
+
+#endif /* HOST_TEST_LIBFUZZER */
@@ -0,0 +1,8 @@
+#ifndef HOST_ESP_ATTR_H_
+#define HOST_ESP_ATTR_H_
+
+// Host stand-in: placement attributes mean nothing off the chip
+
+#define IRAM_ATTR
+
+#endif /* HOST_ESP_ATTR_H_ */
@@ -0,0 +1,6 @@
+#ifndef HOST_ESP_HTTP_SERVER_H_
+#define HOST_ESP_HTTP_SERVER_H_
+
+// Host stand-in: pulled in by wifi_manager.h, nothing host-built uses it
+
+#endif /* HOST_ESP_HTTP_SERVER_H_ */
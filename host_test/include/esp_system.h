@@ -0,0 +1,11 @@
+#ifndef HOST_ESP_SYSTEM_H_
+#define HOST_ESP_SYSTEM_H_
+
+// Host stand-in: fixed heap figures for the metrics report
+
+#include <stdint.h>
+
+static inline uint32_t esp_get_free_heap_size(void) { return 200000; }
+static inline uint32_t esp_get_minimum_free_heap_size(void) { return 180000; }
+
+#endif /* HOST_ESP_SYSTEM_H_ */
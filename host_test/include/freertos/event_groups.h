@@ -0,0 +1,11 @@
+#ifndef HOST_FREERTOS_EVENT_GROUPS_H_
+#define HOST_FREERTOS_EVENT_GROUPS_H_
+
+// Host stand-in: pulled in by wifi_manager.h, nothing host-built uses it
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct mock_event_group *EventGroupHandle_t;
+typedef TickType_t EventBits_t;
+
+#endif /* HOST_FREERTOS_EVENT_GROUPS_H_ */
@@ -0,0 +1,16 @@
+#ifndef HOST_FREERTOS_SEMPHR_H_
+#define HOST_FREERTOS_SEMPHR_H_
+
+// Semaphores are zero-size queues, as in FreeRTOS; mutex ownership is not tracked
+
+#include "freertos/queue.h"
+
+typedef QueueHandle_t SemaphoreHandle_t;
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void);
+SemaphoreHandle_t xSemaphoreCreateBinary(void);
+#define xSemaphoreTake(sem, ticks)  xQueueReceive((sem), NULL, (ticks))
+#define xSemaphoreGive(sem)         xQueueSend((sem), NULL, 0)
+#define vSemaphoreDelete(sem)       vQueueDelete(sem)
+
+#endif /* HOST_FREERTOS_SEMPHR_H_ */
@@ -0,0 +1,23 @@
+#ifndef HOST_COMPAT_H_
+#define HOST_COMPAT_H_
+
+// Force-included into firmware sources built for the host: newlib has
+// strlcpy(), glibc only since 2.38
+
+#include <string.h>
+
+#if defined(__GLIBC__) && !(__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 38))
+static inline size_t strlcpy(char *dst, const char *src, size_t size)
+{
+    size_t len = strlen(src);
+    if (size)
+    {
+        size_t copy = len < size ? len : size - 1;
+        memcpy(dst, src, copy);
+        dst[copy] = '\0';
+    }
+    return len;
+}
+#endif
+
+#endif /* HOST_COMPAT_H_ */
@@ -0,0 +1,27 @@
+#ifndef HOST_TEST_H_
+#define HOST_TEST_H_
+
+#include <stdio.h>
+
+// Minimal assertions for the host tests: failures are counted and reported,
+// HOST_TEST_RESULT() turns the count into the process exit code for ctest
+
+static int host_test_failures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+        host_test_failures++; \
+    } \
+} while (0)
+
+#define CHECK_MSG(cond, format, ...) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: " format "\n", __FILE__, __LINE__, ##__VA_ARGS__); \
+        host_test_failures++; \
+    } \
+} while (0)
+
+#define HOST_TEST_RESULT() (host_test_failures ? (fprintf(stderr, "%d check(s) failed\n", host_test_failures), 1) : 0)
+
+#endif /* HOST_TEST_H_ */
@@ -0,0 +1,11 @@
+#ifndef HOST_SOC_GPIO_REG_H_
+#define HOST_SOC_GPIO_REG_H_
+
+// Host stand-in: the ESP32-C3 GPIO output register addresses
+
+#define DR_REG_GPIO_BASE        0x60004000
+#define GPIO_OUT_REG            (DR_REG_GPIO_BASE + 0x0004)
+#define GPIO_OUT_W1TS_REG       (DR_REG_GPIO_BASE + 0x0008)
+#define GPIO_OUT_W1TC_REG       (DR_REG_GPIO_BASE + 0x000c)
+
+#endif /* HOST_SOC_GPIO_REG_H_ */
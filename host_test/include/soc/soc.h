@@ -0,0 +1,12 @@
+#ifndef HOST_SOC_SOC_H_
+#define HOST_SOC_SOC_H_
+
+// Host stand-in: register writes go to mock/mock_gpio.c instead of the bus
+
+#include <stdint.h>
+
+void mock_reg_write(uint32_t reg, uint32_t value);
+
+#define REG_WRITE(reg, value)   mock_reg_write((reg), (value))
+
+#endif /* HOST_SOC_SOC_H_ */
@@ -0,0 +1,121 @@
+#include <stdlib.h>
+#include "esp_timer.h"
+#include "mock_esp_timer.h"
+#include "mock_freertos.h"
+
+#define MOCK_TIMER_MAX  16
+
+struct esp_timer {
+    esp_timer_cb_t callback;
+    void *arg;
+    bool used;
+    bool active;
+    int64_t expiry_us;
+    uint64_t period_us;     // 0 for a one-shot timer
+};
+
+static struct esp_timer timers[MOCK_TIMER_MAX];
+
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *out_handle)
+{
+    if (args == NULL || args->callback == NULL || out_handle == NULL)
+        return ESP_ERR_INVALID_ARG;
+
+    for (size_t i = 0; i < MOCK_TIMER_MAX; i++)
+    {
+        if (!timers[i].used)
+        {
+            timers[i] = (struct esp_timer){.callback = args->callback, .arg = args->arg, .used = true};
+            *out_handle = &timers[i];
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NO_MEM;
+}
+
+static esp_err_t timer_start(esp_timer_handle_t timer, uint64_t timeout_us, uint64_t period_us)
+{
+    if (timer == NULL || !timer->used)
+        return ESP_ERR_INVALID_ARG;
+    // Like esp_timer, an armed timer has to be stopped before it is started again
+    if (timer->active)
+        return ESP_ERR_INVALID_STATE;
+
+    timer->active = true;
+    timer->expiry_us = mock_clock_us + (int64_t)timeout_us;
+    timer->period_us = period_us;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us)
+{
+    return timer_start(timer, timeout_us, 0);
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period_us)
+{
+    return timer_start(timer, period_us, period_us);
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+    if (timer == NULL || !timer->used)
+        return ESP_ERR_INVALID_ARG;
+    if (!timer->active)
+        return ESP_ERR_INVALID_STATE;
+    timer->active = false;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer)
+{
+    if (timer == NULL || !timer->used)
+        return ESP_ERR_INVALID_ARG;
+    if (timer->active)
+        return ESP_ERR_INVALID_STATE;
+    timer->used = false;
+    return ESP_OK;
+}
+
+bool esp_timer_is_active(esp_timer_handle_t timer)
+{
+    return timer && timer->used && timer->active;
+}
+
+int64_t esp_timer_get_time(void)
+{
+    return mock_clock_us;
+}
+
+int64_t mock_esp_timer_next_expiry(void)
+{
+    int64_t next = INT64_MAX;
+
+    for (size_t i = 0; i < MOCK_TIMER_MAX; i++)
+    {
+        if (timers[i].active && timers[i].expiry_us < next)
+            next = timers[i].expiry_us;
+    }
+    return next;
+}
+
+void mock_esp_timer_fire_due(void)
+{
+    while (mock_esp_timer_next_expiry() <= mock_clock_us)
+    {
+        struct esp_timer *due = NULL;
+        for (size_t i = 0; i < MOCK_TIMER_MAX; i++)
+        {
+            if (timers[i].active && (due == NULL || timers[i].expiry_us < due->expiry_us))
+                due = &timers[i];
+        }
+
+        // Disarmed or rearmed before the callback runs, so it may restart itself
+        if (due->period_us)
+            due->expiry_us += due->period_us;
+        else
+            due->active = false;
+        due->callback(due->arg);
+    }
+}
@@ -0,0 +1,13 @@
+#ifndef MOCK_ESP_TIMER_H_
+#define MOCK_ESP_TIMER_H_
+
+#include <stdint.h>
+
+// Scheduler side of the esp_timer stand-in, called by mock_freertos.c
+
+// Earliest expiry of an armed timer, INT64_MAX if none is armed
+int64_t mock_esp_timer_next_expiry(void);
+// Run the callback of every timer that expired by mock_clock_us, in expiry order
+void mock_esp_timer_fire_due(void);
+
+#endif /* MOCK_ESP_TIMER_H_ */
@@ -0,0 +1,583 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ucontext.h>
+#include "mock_freertos.h"
+#include "mock_esp_timer.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+
+#if defined(__SANITIZE_ADDRESS__)
+#define MOCK_ASAN 1
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define MOCK_ASAN 1
+#endif
+#endif
+
+#if MOCK_ASAN
+#include <sanitizer/common_interface_defs.h>
+#endif
+
+#define MOCK_TASK_MAX           16
+// Host frames are far larger than on the chip, more so under ASan
+#define MOCK_TASK_STACK_SIZE    (512 * 1024)
+#define MOCK_TICK_US            (1000000 / configTICK_RATE_HZ)
+// Task switches and failed polls without the clock moving before the run is
+// declared stuck; nothing preempts a task that polls in a loop
+#define MOCK_SPIN_LIMIT         100000
+
+typedef enum {
+    TASK_READY = 0,
+    TASK_BLOCKED,
+    TASK_SUSPENDED,
+    TASK_DELETED,
+} mock_task_state_t;
+
+struct mock_task {
+    char name[16];
+    UBaseType_t priority;
+    TaskFunction_t fn;
+    void *arg;
+    mock_task_state_t state;
+    ucontext_t ctx;
+    void *stack;
+    const void *wait_on;        // object a blocked task waits for, NULL for a plain delay
+    int64_t wake_at_us;         // INT64_MAX: no timeout
+    bool timed_out;
+    uint64_t last_run;          // round robin between equal priorities
+    uint32_t notify_value;
+    bool notify_pending;
+};
+
+struct mock_queue {
+    size_t item_size;
+    size_t length;
+    size_t count;
+    size_t head;
+    uint8_t *items;
+};
+
+int64_t mock_clock_us = 0;
+uint32_t mock_switch_cost_us = 0;
+
+static struct mock_task tasks[MOCK_TASK_MAX];
+static size_t task_count = 0;
+static struct mock_task *current = NULL;
+static ucontext_t scheduler_ctx;
+static uint64_t run_counter = 0;
+static uint32_t spins = 0;
+
+#if MOCK_ASAN
+static const void *scheduler_stack_bottom;
+static size_t scheduler_stack_size;
+#endif
+
+
+// Scheduler -> task, returns once the task blocks, yields or deletes itself
+static void switch_to_task(struct mock_task *task)
+{
+    current = task;
+    task->last_run = ++run_counter;
+#if MOCK_ASAN
+    void *fake_stack = NULL;
+    __sanitizer_start_switch_fiber(&fake_stack, task->stack, MOCK_TASK_STACK_SIZE);
+#endif
+    swapcontext(&scheduler_ctx, &task->ctx);
+#if MOCK_ASAN
+    __sanitizer_finish_switch_fiber(fake_stack, NULL, NULL);
+#endif
+    current = NULL;
+}
+
+// Task -> scheduler, returns once the scheduler picks the task again
+static void switch_to_scheduler(void)
+{
+    struct mock_task *self = current;
+#if MOCK_ASAN
+    void *fake_stack = NULL;
+    __sanitizer_start_switch_fiber(self->state == TASK_DELETED ? NULL : &fake_stack,
+                                   scheduler_stack_bottom, scheduler_stack_size);
+#endif
+    swapcontext(&self->ctx, &scheduler_ctx);
+#if MOCK_ASAN
+    __sanitizer_finish_switch_fiber(fake_stack, &scheduler_stack_bottom, &scheduler_stack_size);
+#endif
+}
+
+static void task_entry(int index)
+{
+#if MOCK_ASAN
+    __sanitizer_finish_switch_fiber(NULL, &scheduler_stack_bottom, &scheduler_stack_size);
+#endif
+    struct mock_task *self = &tasks[index];
+    self->fn(self->arg);
+
+    fprintf(stderr, "task '%s' returned from its function\n", self->name);
+    abort();
+}
+
+static struct mock_task *require_task(const char *call)
+{
+    if (current == NULL)
+    {
+        fprintf(stderr, "%s would block outside a task\n", call);
+        abort();
+    }
+    return current;
+}
+
+static void count_spin(const char *name)
+{
+    if (++spins > MOCK_SPIN_LIMIT)
+    {
+        fprintf(stderr, "no progress at %lld us, task '%s' keeps running\n", (long long)mock_clock_us, name);
+        abort();
+    }
+}
+
+static int64_t deadline_after(TickType_t ticks)
+{
+    return ticks == portMAX_DELAY ? INT64_MAX : mock_clock_us + (int64_t)ticks * MOCK_TICK_US;
+}
+
+// Returns false if the deadline passed first
+static bool block_until(const void *obj, int64_t deadline)
+{
+    struct mock_task *self = current;
+
+    if (deadline <= mock_clock_us)
+    {
+        count_spin(self->name);
+        return false;
+    }
+    self->state = TASK_BLOCKED;
+    self->wait_on = obj;
+    self->wake_at_us = deadline;
+    self->timed_out = false;
+    switch_to_scheduler();
+    return !self->timed_out;
+}
+
+static void yield(void)
+{
+    current->state = TASK_READY;
+    switch_to_scheduler();
+}
+
+// Readies every task waiting on obj; each re-checks its condition. A woken
+// task above the running one preempts it, as in FreeRTOS.
+static void wake(const void *obj)
+{
+    struct mock_task *woken = NULL;
+
+    for (size_t i = 0; i < task_count; i++)
+    {
+        struct mock_task *task = &tasks[i];
+        if (task->state != TASK_BLOCKED || task->wait_on != obj || obj == NULL)
+            continue;
+        task->state = TASK_READY;
+        task->wait_on = NULL;
+        if (woken == NULL || task->priority > woken->priority)
+            woken = task;
+    }
+    if (woken && current && woken->priority > current->priority)
+        yield();
+}
+
+static struct mock_task *pick_ready(void)
+{
+    struct mock_task *best = NULL;
+
+    for (size_t i = 0; i < task_count; i++)
+    {
+        struct mock_task *task = &tasks[i];
+        if (task->state != TASK_READY)
+            continue;
+        if (best == NULL || task->priority > best->priority ||
+            (task->priority == best->priority && task->last_run < best->last_run))
+        {
+            best = task;
+        }
+    }
+    return best;
+}
+
+static int64_t next_event_us(void)
+{
+    int64_t next = mock_esp_timer_next_expiry();
+
+    for (size_t i = 0; i < task_count; i++)
+    {
+        if (tasks[i].state == TASK_BLOCKED && tasks[i].wake_at_us < next)
+            next = tasks[i].wake_at_us;
+    }
+    return next;
+}
+
+// Timer callbacks and wait timeouts that are due at the current time
+static void fire_due(void)
+{
+    mock_esp_timer_fire_due();
+    for (size_t i = 0; i < task_count; i++)
+    {
+        struct mock_task *blocked = &tasks[i];
+        if (blocked->state == TASK_BLOCKED && blocked->wake_at_us <= mock_clock_us)
+        {
+            blocked->state = TASK_READY;
+            blocked->wait_on = NULL;
+            blocked->timed_out = true;
+        }
+    }
+}
+
+void mock_freertos_run_ms(uint32_t ms)
+{
+    int64_t end = mock_clock_us + (int64_t)ms * 1000;
+    struct mock_task *last = NULL;
+
+    if (current != NULL)
+    {
+        fprintf(stderr, "mock_freertos_run_ms() called from task '%s'\n", current->name);
+        abort();
+    }
+
+    spins = 0;
+    while (1)
+    {
+        struct mock_task *task = pick_ready();
+        if (task)
+        {
+            count_spin(task->name);
+            if (task != last)
+                mock_clock_us += mock_switch_cost_us;
+            last = task;
+            switch_to_task(task);
+            continue;
+        }
+
+        int64_t next = next_event_us();
+        if (next > end)
+        {
+            if (end > mock_clock_us)
+                mock_clock_us = end;
+            return;
+        }
+        if (next > mock_clock_us)
+        {
+            mock_clock_us = next;
+            spins = 0;
+        }
+        // Timer callbacks run here, in what stands for the esp_timer task
+        fire_due();
+    }
+}
+
+void mock_freertos_busy_us(uint32_t us)
+{
+    struct mock_task *self = current;
+    int64_t remaining = us;
+
+    while (remaining > 0)
+    {
+        int64_t step = next_event_us() - mock_clock_us;
+        step = step < 0 ? 0 : (step < remaining ? step : remaining);
+        mock_clock_us += step;
+        remaining -= step;
+        fire_due();
+
+        // Preempted by anything above it that became ready meanwhile; the
+        // rest of the work continues once it runs again
+        struct mock_task *ready = pick_ready();
+        if (self && ready && ready->priority > self->priority)
+            yield();
+    }
+}
+
+TaskHandle_t mock_freertos_current(void)
+{
+    return current;
+}
+
+TaskHandle_t mock_freertos_find(const char *name)
+{
+    for (size_t i = 0; i < task_count; i++)
+    {
+        // Names are cut to configMAX_TASK_NAME_LEN like on the device
+        if (tasks[i].state != TASK_DELETED && strncmp(tasks[i].name, name, sizeof(tasks[i].name) - 1) == 0)
+            return &tasks[i];
+    }
+    return NULL;
+}
+
+bool mock_freertos_blocked_forever(TaskHandle_t task)
+{
+    return task && task->state == TASK_BLOCKED && task->wake_at_us == INT64_MAX;
+}
+
+BaseType_t xPortInIsrContext(void)
+{
+    return pdFALSE;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack_depth, void *arg,
+                       UBaseType_t priority, TaskHandle_t *out_handle)
+{
+    if (task_count >= MOCK_TASK_MAX)
+        return pdFAIL;
+
+    struct mock_task *task = &tasks[task_count];
+    memset(task, 0, sizeof(*task));
+    snprintf(task->name, sizeof(task->name), "%s", name);
+    task->priority = priority;
+    task->fn = fn;
+    task->arg = arg;
+    task->wake_at_us = INT64_MAX;
+    task->stack = malloc(MOCK_TASK_STACK_SIZE);
+    if (task->stack == NULL)
+        return pdFAIL;
+
+    getcontext(&task->ctx);
+    task->ctx.uc_stack.ss_sp = task->stack;
+    task->ctx.uc_stack.ss_size = MOCK_TASK_STACK_SIZE;
+    task->ctx.uc_link = NULL;
+    makecontext(&task->ctx, (void (*)(void))task_entry, 1, (int)task_count);
+    task_count++;
+    task->state = TASK_READY;
+
+    // The handle is out before the task can run, as in FreeRTOS
+    if (out_handle)
+        *out_handle = task;
+    if (current && priority > current->priority)
+        yield();
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    if (task == NULL || task == current)
+    {
+        require_task("vTaskDelete(NULL)")->state = TASK_DELETED;
+        switch_to_scheduler();
+        abort();
+    }
+    task->state = TASK_DELETED;
+}
+
+void vTaskSuspend(TaskHandle_t task)
+{
+    if (task == NULL || task == current)
+    {
+        require_task("vTaskSuspend(NULL)")->state = TASK_SUSPENDED;
+        switch_to_scheduler();
+        return;
+    }
+    task->state = TASK_SUSPENDED;
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    require_task("vTaskDelay");
+    if (ticks == 0)
+        yield();
+    else
+        block_until(NULL, deadline_after(ticks));
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return (TickType_t)(mock_clock_us / MOCK_TICK_US);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    return current;
+}
+
+const char *pcTaskGetName(TaskHandle_t task)
+{
+    task = task ? task : current;
+    return task ? task->name : "main";
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task)
+{
+    return MOCK_TASK_STACK_SIZE / sizeof(StackType_t);
+}
+
+BaseType_t xTaskNotify(TaskHandle_t task, uint32_t value, eNotifyAction action)
+{
+    switch (action)
+    {
+    case eSetBits:
+        task->notify_value |= value;
+        break;
+    case eIncrement:
+        task->notify_value++;
+        break;
+    case eSetValueWithoutOverwrite:
+        if (task->notify_pending)
+            return pdFAIL;
+        task->notify_value = value;
+        break;
+    case eSetValueWithOverwrite:
+        task->notify_value = value;
+        break;
+    case eNoAction:
+        break;
+    }
+    task->notify_pending = true;
+    wake(&task->notify_value);
+    return pdPASS;
+}
+
+BaseType_t xTaskNotifyFromISR(TaskHandle_t task, uint32_t value, eNotifyAction action, BaseType_t *woken)
+{
+    if (woken && (current == NULL || task->priority > current->priority))
+        *woken = pdTRUE;
+    return xTaskNotify(task, value, action);
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    return xTaskNotify(task, 0, eIncrement);
+}
+
+BaseType_t xTaskNotifyWait(uint32_t clear_on_entry, uint32_t clear_on_exit, uint32_t *value, TickType_t ticks)
+{
+    struct mock_task *self = require_task("xTaskNotifyWait");
+
+    if (!self->notify_pending)
+    {
+        int64_t deadline = deadline_after(ticks);
+        self->notify_value &= ~clear_on_entry;
+        while (!self->notify_pending && block_until(&self->notify_value, deadline))
+        {
+        }
+    }
+    if (value)
+        *value = self->notify_value;
+    if (!self->notify_pending)
+        return pdFALSE;
+    self->notify_value &= ~clear_on_exit;
+    self->notify_pending = false;
+    return pdTRUE;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks)
+{
+    struct mock_task *self = require_task("ulTaskNotifyTake");
+    int64_t deadline = deadline_after(ticks);
+
+    while (self->notify_value == 0 && block_until(&self->notify_value, deadline))
+    {
+    }
+    uint32_t value = self->notify_value;
+    if (value)
+        self->notify_value = clear_on_exit ? 0 : value - 1;
+    self->notify_pending = false;
+    return value;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+    struct mock_queue *queue = calloc(1, sizeof(*queue));
+    if (queue == NULL)
+        return NULL;
+    queue->item_size = item_size;
+    queue->length = length;
+    queue->items = calloc(length, item_size ? item_size : 1);
+    if (queue->items == NULL)
+    {
+        free(queue);
+        return NULL;
+    }
+    return queue;
+}
+
+void vQueueDelete(QueueHandle_t queue)
+{
+    if (queue)
+    {
+        free(queue->items);
+        free(queue);
+    }
+}
+
+// From test (ISR) context a full or empty queue fails at once, it cannot wait
+static bool queue_wait(QueueHandle_t queue, int64_t deadline, TickType_t ticks)
+{
+    if (current == NULL)
+        return false;
+    if (ticks == 0)
+    {
+        count_spin(current->name);
+        return false;
+    }
+    return block_until(queue, deadline);
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks)
+{
+    int64_t deadline = deadline_after(ticks);
+
+    while (queue->count == queue->length)
+    {
+        if (!queue_wait(queue, deadline, ticks))
+            return pdFAIL;
+    }
+    size_t tail = (queue->head + queue->count) % queue->length;
+    if (queue->item_size)
+        memcpy(&queue->items[tail * queue->item_size], item, queue->item_size);
+    queue->count++;
+    wake(queue);
+    return pdPASS;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks)
+{
+    int64_t deadline = deadline_after(ticks);
+
+    while (queue->count == 0)
+    {
+        if (!queue_wait(queue, deadline, ticks))
+            return pdFAIL;
+    }
+    if (queue->item_size)
+        memcpy(item, &queue->items[queue->head * queue->item_size], queue->item_size);
+    queue->head = (queue->head + 1) % queue->length;
+    queue->count--;
+    wake(queue);
+    return pdPASS;
+}
+
+BaseType_t xQueueOverwrite(QueueHandle_t queue, const void *item)
+{
+    if (queue->length != 1)
+    {
+        fprintf(stderr, "xQueueOverwrite() on a queue of length %zu\n", queue->length);
+        abort();
+    }
+    memcpy(&queue->items[queue->head * queue->item_size], item, queue->item_size);
+    queue->count = 1;
+    wake(queue);
+    return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+    return queue->count;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    SemaphoreHandle_t sem = xQueueCreate(1, 0);
+    if (sem)
+        sem->count = 1;
+    return sem;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+    return xQueueCreate(1, 0);
+}
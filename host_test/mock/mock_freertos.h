@@ -0,0 +1,39 @@
+#ifndef MOCK_FREERTOS_H_
+#define MOCK_FREERTOS_H_
+
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+/*
+ * Test-side control of the simulated FreeRTOS in mock_freertos.c.
+ *
+ * Tasks run one at a time on their own stacks and switch only where a real
+ * task would block or be preempted: a blocking call, a wake of a higher
+ * priority task, vTaskDelay(). Time is virtual and only moves while nothing
+ * is ready, so a run is fully repeatable. The test's main() plays app_main
+ * and the ISRs: tasks it creates run once it calls mock_freertos_run_ms().
+ */
+
+// Virtual time since boot, esp_timer_get_time() returns it
+extern int64_t mock_clock_us;
+
+// Run every ready task, firing timers and timeouts as the clock passes them,
+// until `ms` of virtual time have gone by
+void mock_freertos_run_ms(uint32_t ms);
+
+// Cost model for timing runs, both are free unless a test sets them:
+// virtual time charged whenever a different task is switched in
+extern uint32_t mock_switch_cost_us;
+// The caller computes for `us` of virtual time. Timers fire meanwhile and a
+// higher priority task that becomes ready preempts it, as a tick would.
+void mock_freertos_busy_us(uint32_t us);
+
+// The task a blocking call would suspend, NULL in test (app_main/ISR) context
+TaskHandle_t mock_freertos_current(void);
+// Find a task by the name given to xTaskCreate()
+TaskHandle_t mock_freertos_find(const char *name);
+// True while the task is blocked in a wait that has no timeout
+bool mock_freertos_blocked_forever(TaskHandle_t task);
+
+#endif /* MOCK_FREERTOS_H_ */
@@ -0,0 +1,82 @@
+#include <string.h>
+#include "mock_gpio.h"
+#include "soc/soc.h"
+#include "soc/gpio_reg.h"
+
+mock_gpio_t mock_gpio;
+
+void mock_gpio_reset(void)
+{
+    memset(&mock_gpio, 0, sizeof(mock_gpio));
+    mock_gpio.levels = UINT32_MAX;
+}
+
+void mock_reg_write(uint32_t reg, uint32_t value)
+{
+    switch (reg)
+    {
+    case GPIO_OUT_W1TS_REG:
+        mock_gpio.out |= value;
+        mock_gpio.last_w1ts = value;
+        mock_gpio.w1ts_writes++;
+        break;
+    case GPIO_OUT_W1TC_REG:
+        mock_gpio.out &= ~value;
+        mock_gpio.last_w1tc = value;
+        mock_gpio.w1tc_writes++;
+        break;
+    default:
+        mock_gpio.other_writes++;
+        break;
+    }
+}
+
+esp_err_t gpio_config(const gpio_config_t *config)
+{
+    return config ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t gpio_set_level(gpio_num_t gpio_num, uint32_t level)
+{
+    if (gpio_num < 0 || gpio_num >= GPIO_NUM_MAX)
+        return ESP_ERR_INVALID_ARG;
+    if (level)
+        mock_gpio.out |= (1UL << gpio_num);
+    else
+        mock_gpio.out &= ~(1UL << gpio_num);
+    return ESP_OK;
+}
+
+int gpio_get_level(gpio_num_t gpio_num)
+{
+    if (gpio_num < 0 || gpio_num >= GPIO_NUM_MAX)
+        return 0;
+    return (mock_gpio.levels >> gpio_num) & 1;
+}
+
+esp_err_t gpio_install_isr_service(int intr_alloc_flags)
+{
+    return ESP_OK;
+}
+
+esp_err_t gpio_isr_handler_add(gpio_num_t gpio_num, gpio_isr_t isr_handler, void *args)
+{
+    if (gpio_num < 0 || gpio_num >= GPIO_NUM_MAX)
+        return ESP_ERR_INVALID_ARG;
+    mock_gpio.isr[gpio_num] = isr_handler;
+    mock_gpio.isr_arg[gpio_num] = args;
+    return ESP_OK;
+}
+
+void mock_gpio_set_input(gpio_num_t pin, int level)
+{
+    uint32_t bit = 1UL << pin;
+    bool changed = ((mock_gpio.levels & bit) != 0) != (level != 0);
+
+    if (level)
+        mock_gpio.levels |= bit;
+    else
+        mock_gpio.levels &= ~bit;
+    if (changed && mock_gpio.isr[pin])
+        mock_gpio.isr[pin](mock_gpio.isr_arg[pin]);
+}
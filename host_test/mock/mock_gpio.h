@@ -0,0 +1,29 @@
+#ifndef MOCK_GPIO_H_
+#define MOCK_GPIO_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "driver/gpio.h"
+
+// Test-side view of the fake GPIO block behind driver/gpio.h and REG_WRITE
+
+typedef struct {
+    uint32_t out;               // GPIO_OUT: W1TS/W1TC and gpio_set_level() land here
+    uint32_t last_w1ts;         // value of the most recent write, 0 if none since reset
+    uint32_t last_w1tc;
+    uint32_t w1ts_writes;       // register writes since the last mock_gpio_reset()
+    uint32_t w1tc_writes;
+    uint32_t other_writes;      // writes to any other register
+    uint32_t levels;            // input level per pin, 1 = high (pull-up idle)
+    gpio_isr_t isr[GPIO_NUM_MAX];
+    void *isr_arg[GPIO_NUM_MAX];
+} mock_gpio_t;
+
+extern mock_gpio_t mock_gpio;
+
+// Output register cleared, every input high, no handlers
+void mock_gpio_reset(void);
+// Drive an input and, like GPIO_INTR_ANYEDGE, call its handler on a change
+void mock_gpio_set_input(gpio_num_t pin, int level);
+
+#endif /* MOCK_GPIO_H_ */
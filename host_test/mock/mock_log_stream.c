@@ -0,0 +1,16 @@
+#include <stdio.h>
+#include "mock_log_stream.h"
+
+mock_log_stream_t mock_log_stream;
+
+void log_stream_set_sink(log_stream_sink_t sink)
+{
+    mock_log_stream.sink = sink;
+}
+
+esp_err_t log_stream_apply_setting(const char *data, size_t data_len)
+{
+    snprintf(mock_log_stream.setting, sizeof(mock_log_stream.setting), "%.*s", (int)data_len, data);
+    mock_log_stream.settings_applied++;
+    return ESP_OK;
+}
@@ -0,0 +1,17 @@
+#ifndef MOCK_LOG_STREAM_H_
+#define MOCK_LOG_STREAM_H_
+
+#include <stdint.h>
+#include "log_stream.h"
+
+// Host implementation of the log_stream.h calls mqtt.c makes
+
+typedef struct {
+    log_stream_sink_t sink;     // as last set by log_stream_set_sink()
+    char setting[64];           // last payload given to log_stream_apply_setting()
+    uint32_t settings_applied;
+} mock_log_stream_t;
+
+extern mock_log_stream_t mock_log_stream;
+
+#endif /* MOCK_LOG_STREAM_H_ */
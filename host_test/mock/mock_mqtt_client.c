@@ -0,0 +1,235 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mock_mqtt_client.h"
+#include "mock_freertos.h"
+#include "freertos/queue.h"
+
+#define MOCK_MQTT_EVENT_QUEUE_LEN   32
+
+typedef struct {
+    esp_mqtt_event_id_t id;
+    char *topic;            // owned, NULL on follow-up chunks
+    int topic_len;
+    char *data;             // owned
+    int data_len;
+    int total_data_len;
+    int current_data_offset;
+} mock_mqtt_event_t;
+
+struct esp_mqtt_client {
+    esp_event_handler_t handler;
+    void *handler_args;
+    QueueHandle_t events;
+    TaskHandle_t task;
+    int next_msg_id;
+};
+
+mock_mqtt_t mock_mqtt;
+
+static struct esp_mqtt_client *the_client = NULL;
+static mock_mqtt_publish_t publish_log[MOCK_MQTT_PUBLISH_LOG];
+static uint32_t publish_logged = 0;
+
+
+static void mock_mqtt_event_free(mock_mqtt_event_t *event)
+{
+    free(event->topic);
+    free(event->data);
+}
+
+// Stands in for the esp-mqtt task: one broker event per wakeup
+static void mock_mqtt_task(void *arg)
+{
+    struct esp_mqtt_client *client = arg;
+    mock_mqtt_event_t queued;
+
+    while (1)
+    {
+        xQueueReceive(client->events, &queued, portMAX_DELAY);
+
+        esp_mqtt_event_t event = {
+            .event_id = queued.id,
+            .client = client,
+            .topic = queued.topic,
+            .topic_len = queued.topic_len,
+            .data = queued.data,
+            .data_len = queued.data_len,
+            .total_data_len = queued.total_data_len,
+            .current_data_offset = queued.current_data_offset,
+        };
+        if (queued.id == MQTT_EVENT_CONNECTED)
+            mock_mqtt.connected = true;
+        else if (queued.id == MQTT_EVENT_DISCONNECTED)
+            mock_mqtt.connected = false;
+
+        if (client->handler)
+            client->handler(client->handler_args, "MQTT_EVENTS", queued.id, &event);
+        mock_mqtt_event_free(&queued);
+    }
+}
+
+static void mock_mqtt_queue(mock_mqtt_event_t *event)
+{
+    if (the_client == NULL || !mock_mqtt.started)
+    {
+        fprintf(stderr, "MQTT event %d queued before esp_mqtt_client_start()\n", event->id);
+        abort();
+    }
+    if (xQueueSend(the_client->events, event, 0) != pdPASS)
+    {
+        fprintf(stderr, "MQTT event queue full, run the scheduler between events\n");
+        abort();
+    }
+}
+
+void mock_mqtt_connect(void)
+{
+    mock_mqtt_event_t event = {.id = MQTT_EVENT_CONNECTED};
+    mock_mqtt_queue(&event);
+}
+
+void mock_mqtt_disconnect(void)
+{
+    mock_mqtt_event_t event = {.id = MQTT_EVENT_DISCONNECTED};
+    mock_mqtt_queue(&event);
+}
+
+void mock_mqtt_deliver(const char *topic, const char *data, size_t chunk)
+{
+    size_t total = strlen(data);
+    size_t offset = 0;
+
+    if (chunk == 0 || chunk > total)
+        chunk = total;
+    do
+    {
+        size_t len = total - offset < chunk ? total - offset : chunk;
+        mock_mqtt_event_t event = {
+            .id = MQTT_EVENT_DATA,
+            .data = malloc(len + 1),
+            .data_len = (int)len,
+            .total_data_len = (int)total,
+            .current_data_offset = (int)offset,
+        };
+        memcpy(event.data, data + offset, len);
+        if (offset == 0)
+        {
+            event.topic = strdup(topic);
+            event.topic_len = (int)strlen(topic);
+        }
+        mock_mqtt_queue(&event);
+        offset += len;
+    } while (offset < total);
+}
+
+const mock_mqtt_publish_t *mock_mqtt_last_publish(const char *topic)
+{
+    uint32_t kept = publish_logged < MOCK_MQTT_PUBLISH_LOG ? publish_logged : MOCK_MQTT_PUBLISH_LOG;
+
+    for (uint32_t i = 1; i <= kept; i++)
+    {
+        const mock_mqtt_publish_t *entry = &publish_log[(publish_logged - i) % MOCK_MQTT_PUBLISH_LOG];
+        if (strcmp(entry->topic, topic) == 0)
+            return entry;
+    }
+    return NULL;
+}
+
+void mock_mqtt_clear_log(void)
+{
+    publish_logged = 0;
+    mock_mqtt.publish_count = 0;
+}
+
+esp_mqtt_client_handle_t esp_mqtt_client_init(const esp_mqtt_client_config_t *config)
+{
+    if (the_client != NULL)
+    {
+        fprintf(stderr, "second esp_mqtt_client_init() without destroy\n");
+        abort();
+    }
+    the_client = calloc(1, sizeof(*the_client));
+    the_client->events = xQueueCreate(MOCK_MQTT_EVENT_QUEUE_LEN, sizeof(mock_mqtt_event_t));
+    return the_client;
+}
+
+esp_err_t esp_mqtt_client_register_event(esp_mqtt_client_handle_t client, esp_mqtt_event_id_t event,
+                                         esp_event_handler_t handler, void *handler_args)
+{
+    if (client == NULL)
+        return ESP_ERR_INVALID_ARG;
+    client->handler = handler;
+    client->handler_args = handler_args;
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_start(esp_mqtt_client_handle_t client)
+{
+    if (client == NULL || client->task != NULL)
+        return ESP_FAIL;
+    if (xTaskCreate(mock_mqtt_task, "mqtt_task", 6144, client, MOCK_MQTT_TASK_PRIORITY, &client->task) != pdPASS)
+        return ESP_FAIL;
+    mock_mqtt.started = true;
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_stop(esp_mqtt_client_handle_t client)
+{
+    if (client == NULL || client->task == NULL)
+        return ESP_FAIL;
+    vTaskDelete(client->task);
+    client->task = NULL;
+    mock_mqtt.started = false;
+    mock_mqtt.connected = false;
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_destroy(esp_mqtt_client_handle_t client)
+{
+    mock_mqtt_event_t queued;
+
+    if (client == NULL)
+        return ESP_ERR_INVALID_ARG;
+    if (client->task)
+        esp_mqtt_client_stop(client);
+    while (xQueueReceive(client->events, &queued, 0) == pdPASS)
+        mock_mqtt_event_free(&queued);
+    vQueueDelete(client->events);
+    free(client);
+    the_client = NULL;
+    return ESP_OK;
+}
+
+int esp_mqtt_client_publish(esp_mqtt_client_handle_t client, const char *topic, const char *data, int len,
+                            int qos, int retain)
+{
+    if (client == NULL || !mock_mqtt.connected || mock_mqtt.refuse_publish)
+        return -1;
+    if (len == 0)
+        len = (int)strlen(data);
+    if (mock_mqtt.publish_cost_us)
+        mock_freertos_busy_us(mock_mqtt.publish_cost_us);
+
+    mock_mqtt_publish_t *entry = &publish_log[publish_logged++ % MOCK_MQTT_PUBLISH_LOG];
+    snprintf(entry->topic, sizeof(entry->topic), "%s", topic);
+    entry->len = len < MOCK_MQTT_DATA_MAX ? len : MOCK_MQTT_DATA_MAX - 1;
+    memcpy(entry->data, data, entry->len);
+    entry->data[entry->len] = '\0';
+    entry->qos = qos;
+    entry->retain = retain;
+    mock_mqtt.publish_count++;
+    return qos ? ++client->next_msg_id : 0;
+}
+
+int esp_mqtt_client_subscribe(esp_mqtt_client_handle_t client, const char *topic, int qos)
+{
+    if (client == NULL || !mock_mqtt.connected)
+        return -1;
+    if (mock_mqtt.subscribe_count < MOCK_MQTT_MAX_SUBS)
+    {
+        snprintf(mock_mqtt.subscriptions[mock_mqtt.subscribe_count], MOCK_MQTT_TOPIC_MAX, "%s", topic);
+    }
+    mock_mqtt.subscribe_count++;
+    return ++client->next_msg_id;
+}
@@ -0,0 +1,52 @@
+#ifndef MOCK_MQTT_CLIENT_H_
+#define MOCK_MQTT_CLIENT_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "mqtt_client.h"
+
+// Test-side control of the fake esp-mqtt client in mock_mqtt_client.c. Like
+// the real one it owns a task that calls the event handler; the test queues
+// broker events for it and reads back what the firmware published.
+
+#define MOCK_MQTT_TOPIC_MAX     160
+#define MOCK_MQTT_DATA_MAX      1024
+#define MOCK_MQTT_PUBLISH_LOG   32
+#define MOCK_MQTT_MAX_SUBS      8
+// esp-mqtt's default task priority
+#define MOCK_MQTT_TASK_PRIORITY 5
+
+typedef struct {
+    char topic[MOCK_MQTT_TOPIC_MAX];
+    char data[MOCK_MQTT_DATA_MAX];
+    int len;
+    int qos;
+    int retain;
+} mock_mqtt_publish_t;
+
+typedef struct {
+    bool started;
+    bool connected;
+    bool refuse_publish;        // publish returns -1, as with a full outbox
+    uint32_t publish_cost_us;   // virtual CPU time one publish takes, see mock_freertos_busy_us()
+    uint32_t publish_count;     // accepted publishes since the last reset
+    uint32_t subscribe_count;
+    char subscriptions[MOCK_MQTT_MAX_SUBS][MOCK_MQTT_TOPIC_MAX];
+} mock_mqtt_t;
+
+extern mock_mqtt_t mock_mqtt;
+
+// Queue a broker event; the client task delivers it once the scheduler runs
+void mock_mqtt_connect(void);
+void mock_mqtt_disconnect(void);
+// Deliver a message on topic in chunks of at most `chunk` bytes, 0 for one event.
+// As in esp-mqtt only the first chunk carries the topic.
+void mock_mqtt_deliver(const char *topic, const char *data, size_t chunk);
+
+// Most recent accepted publish on topic, NULL if there was none
+const mock_mqtt_publish_t *mock_mqtt_last_publish(const char *topic);
+// Forget the publish log and counters, the client itself is kept
+void mock_mqtt_clear_log(void);
+
+#endif /* MOCK_MQTT_CLIENT_H_ */
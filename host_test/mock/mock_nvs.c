@@ -0,0 +1,267 @@
+#include <stdbool.h>
+#include <string.h>
+#include "nvs.h"
+#include "nvs_flash.h"
+#include "mock_nvs.h"
+
+#define MOCK_NVS_MAX_KEYS       16
+#define MOCK_NVS_KEY_MAX_LEN    15      // NVS_KEY_NAME_MAX_SIZE - 1
+#define MOCK_NVS_VALUE_MAX_LEN  512
+
+typedef enum {
+    MOCK_NVS_STR = 0,
+    MOCK_NVS_U32,
+    MOCK_NVS_BLOB,
+} mock_nvs_type_t;
+
+typedef struct {
+    char key[MOCK_NVS_KEY_MAX_LEN + 1];
+    mock_nvs_type_t type;
+    size_t len;
+    uint8_t value[MOCK_NVS_VALUE_MAX_LEN];
+    uint8_t page;           // where the live copy is
+    uint8_t span;           // entries it takes there
+} mock_nvs_entry_t;
+
+typedef enum {
+    PAGE_FREE = 0,
+    PAGE_ACTIVE,
+    PAGE_FULL,
+} mock_nvs_page_state_t;
+
+typedef struct {
+    mock_nvs_page_state_t state;
+    uint16_t used;          // entries written since the last erase
+    uint16_t erased;        // of those, superseded or deleted
+} mock_nvs_page_t;
+
+mock_nvs_t mock_nvs;
+
+// One namespace is enough for storage_manager.c
+static mock_nvs_entry_t entries[MOCK_NVS_MAX_KEYS];
+static size_t entry_count = 0;
+
+static mock_nvs_page_t pages[MOCK_NVS_PAGES];
+static uint8_t active_page = 0;
+
+
+void mock_nvs_reset(void)
+{
+    memset(entries, 0, sizeof(entries));
+    entry_count = 0;
+    memset(pages, 0, sizeof(pages));
+    active_page = 0;
+    pages[active_page].state = PAGE_ACTIVE;
+    memset(&mock_nvs, 0, sizeof(mock_nvs));
+}
+
+uint32_t mock_nvs_max_page_erases(void)
+{
+    uint32_t max = 0;
+    for (uint8_t i = 0; i < MOCK_NVS_PAGES; i++)
+    {
+        if (mock_nvs.page_erase_count[i] > max)
+            max = mock_nvs.page_erase_count[i];
+    }
+    return max;
+}
+
+// Entries an item takes: strings and blobs need a header entry plus their
+// data rounded up to whole entries, a u32 fits in the header
+static uint8_t item_span(mock_nvs_type_t type, size_t len)
+{
+    if (type == MOCK_NVS_U32)
+        return 1;
+    // Blobs also carry a blob index entry
+    return (type == MOCK_NVS_BLOB ? 2 : 1) + (len + MOCK_NVS_ENTRY_SIZE - 1) / MOCK_NVS_ENTRY_SIZE;
+}
+
+static uint8_t free_page_count(void)
+{
+    uint8_t count = 0;
+    for (uint8_t i = 0; i < MOCK_NVS_PAGES; i++)
+        count += (pages[i].state == PAGE_FREE);
+    return count;
+}
+
+static uint8_t first_free_page(void)
+{
+    for (uint8_t i = 0; i < MOCK_NVS_PAGES; i++)
+    {
+        if (pages[i].state == PAGE_FREE)
+            return i;
+    }
+    return MOCK_NVS_PAGES;
+}
+
+static void page_append(uint8_t page, mock_nvs_entry_t *entry)
+{
+    entry->page = page;
+    pages[page].used += entry->span;
+    mock_nvs.entries_written += entry->span;
+}
+
+// Like the NVS garbage collector: one page is always kept free, and when it
+// is the last one the full page with the most erased entries has its live
+// items moved there and is erased
+static bool reclaim_page(void)
+{
+    uint8_t victim = MOCK_NVS_PAGES;
+    for (uint8_t i = 0; i < MOCK_NVS_PAGES; i++)
+    {
+        if (pages[i].state == PAGE_FULL && (victim == MOCK_NVS_PAGES || pages[i].erased > pages[victim].erased))
+            victim = i;
+    }
+    if (victim == MOCK_NVS_PAGES || pages[victim].erased == 0)
+        return false;
+
+    active_page = first_free_page();
+    pages[active_page].state = PAGE_ACTIVE;
+    for (size_t i = 0; i < entry_count; i++)
+    {
+        if (entries[i].page == victim)
+            page_append(active_page, &entries[i]);
+    }
+
+    pages[victim] = (mock_nvs_page_t){.state = PAGE_FREE};
+    mock_nvs.page_erases++;
+    mock_nvs.page_erase_count[victim]++;
+    return true;
+}
+
+static bool page_alloc(uint8_t span)
+{
+    while (pages[active_page].used + span > MOCK_NVS_PAGE_ENTRIES)
+    {
+        pages[active_page].state = PAGE_FULL;
+        if (free_page_count() > 1)
+        {
+            active_page = first_free_page();
+            pages[active_page].state = PAGE_ACTIVE;
+        }
+        else if (!reclaim_page())
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static mock_nvs_entry_t *find(const char *key)
+{
+    for (size_t i = 0; i < entry_count; i++)
+    {
+        if (strcmp(entries[i].key, key) == 0)
+            return &entries[i];
+    }
+    return NULL;
+}
+
+static esp_err_t set(const char *key, mock_nvs_type_t type, const void *value, size_t len)
+{
+    if (strlen(key) > MOCK_NVS_KEY_MAX_LEN || len > MOCK_NVS_VALUE_MAX_LEN)
+        return ESP_ERR_INVALID_ARG;
+
+    mock_nvs_entry_t *entry = find(key);
+    // NVS does not rewrite an item that already holds the same value
+    if (entry && entry->type == type && entry->len == len && memcmp(entry->value, value, len) == 0)
+        return ESP_OK;
+    if (entry == NULL && entry_count == MOCK_NVS_MAX_KEYS)
+        return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+
+    uint8_t span = item_span(type, len);
+    if (!page_alloc(span))
+        return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+
+    if (entry == NULL)
+    {
+        entry = &entries[entry_count++];
+        strcpy(entry->key, key);
+    }
+    else
+    {
+        pages[entry->page].erased += entry->span;
+    }
+    entry->type = type;
+    entry->len = len;
+    entry->span = span;
+    memcpy(entry->value, value, len);
+    page_append(active_page, entry);
+    mock_nvs.writes++;
+    return ESP_OK;
+}
+
+static esp_err_t get(const char *key, mock_nvs_type_t type, void *value, size_t *len)
+{
+    mock_nvs_entry_t *entry = find(key);
+    if (entry == NULL || entry->type != type)
+        return ESP_ERR_NVS_NOT_FOUND;
+    if (*len < entry->len)
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    memcpy(value, entry->value, entry->len);
+    *len = entry->len;
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_init(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase(void)
+{
+    mock_nvs_reset();
+    return ESP_OK;
+}
+
+esp_err_t nvs_open(const char *name_space, nvs_open_mode_t open_mode, nvs_handle_t *out_handle)
+{
+    *out_handle = 1;
+    return ESP_OK;
+}
+
+esp_err_t nvs_get_str(nvs_handle_t handle, const char *key, char *out_value, size_t *length)
+{
+    return get(key, MOCK_NVS_STR, out_value, length);
+}
+
+esp_err_t nvs_get_u32(nvs_handle_t handle, const char *key, uint32_t *out_value)
+{
+    size_t len = sizeof(*out_value);
+    return get(key, MOCK_NVS_U32, out_value, &len);
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out_value, size_t *length)
+{
+    return get(key, MOCK_NVS_BLOB, out_value, length);
+}
+
+esp_err_t nvs_set_str(nvs_handle_t handle, const char *key, const char *value)
+{
+    return set(key, MOCK_NVS_STR, value, strlen(value) + 1);
+}
+
+esp_err_t nvs_set_u32(nvs_handle_t handle, const char *key, uint32_t value)
+{
+    return set(key, MOCK_NVS_U32, &value, sizeof(value));
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length)
+{
+    return set(key, MOCK_NVS_BLOB, value, length);
+}
+
+esp_err_t nvs_erase_all(nvs_handle_t handle)
+{
+    for (size_t i = 0; i < entry_count; i++)
+        pages[entries[i].page].erased += entries[i].span;
+    memset(entries, 0, sizeof(entries));
+    entry_count = 0;
+    return ESP_OK;
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle)
+{
+    mock_nvs.commits++;
+    return ESP_OK;
+}
@@ -0,0 +1,32 @@
+#ifndef MOCK_NVS_H_
+#define MOCK_NVS_H_
+
+#include <stdint.h>
+
+// Test-side view of the in-RAM NVS behind nvs.h. Besides the values it models
+// how NVS lays items out on flash: each write appends entries to the active
+// page and leaves the old copy behind as erased, and a full partition is
+// reclaimed one page at a time, which costs a sector erase.
+
+// The default 24 KB "nvs" partition
+#define MOCK_NVS_PAGES          6
+// A 4 KB page minus its header and entry state bitmap holds 126 32-byte entries
+#define MOCK_NVS_PAGE_ENTRIES   126
+#define MOCK_NVS_ENTRY_SIZE     32
+
+typedef struct {
+    uint32_t writes;                        // nvs_set_*() calls that stored a value
+    uint32_t commits;
+    uint32_t entries_written;               // including the live ones moved by page reclaims
+    uint32_t page_erases;
+    uint32_t page_erase_count[MOCK_NVS_PAGES];
+} mock_nvs_t;
+
+extern mock_nvs_t mock_nvs;
+
+// Forget every key, format the partition and zero the counters
+void mock_nvs_reset(void);
+// Erases of the most worn page, the one that wears out first
+uint32_t mock_nvs_max_page_erases(void);
+
+#endif /* MOCK_NVS_H_ */
@@ -0,0 +1,16 @@
+#include "relay_output.h"
+#include "mock_relay_output.h"
+
+mock_relay_output_t mock_relay_output;
+
+void relay_output_init(const gpio_num_t *pins, uint8_t count)
+{
+    mock_relay_output.count = count;
+    mock_relay_output.state = 0;
+}
+
+void relay_output_write(uint32_t state)
+{
+    mock_relay_output.state = state;
+    mock_relay_output.writes++;
+}
@@ -0,0 +1,16 @@
+#ifndef MOCK_RELAY_OUTPUT_H_
+#define MOCK_RELAY_OUTPUT_H_
+
+#include <stdint.h>
+
+// Host implementation of relay_output.h: records what control.c drives
+
+typedef struct {
+    uint8_t count;          // channels passed to relay_output_init()
+    uint32_t state;         // last state written
+    uint32_t writes;
+} mock_relay_output_t;
+
+extern mock_relay_output_t mock_relay_output;
+
+#endif /* MOCK_RELAY_OUTPUT_H_ */
@@ -0,0 +1,228 @@
+#include <inttypes.h>
+#include "host_test.h"
+#include "mock_freertos.h"
+#include "mock_gpio.h"
+#include "mock_nvs.h"
+#include "mock_relay_output.h"
+#include "control.h"
+
+// control.c on the simulated scheduler: commands, the button task with its
+// debounce timer, the reset hold and the delayed relay save. One boot per
+// process, so the cases run in order on one timeline and each starts from
+// the state the previous one left.
+
+#define SAVED_STATE     0x2
+#define DEBOUNCE_US     (BUTTON_DEBOUNCE_MS * 1000)
+
+static uint32_t published_state = 0;
+static uint32_t publish_calls = 0;
+static uint32_t ap_mode_requests = 0;
+
+// Stand-ins for the MQTT and Wi-Fi side control.c reports to
+void mqtt_send_to_publish(uint32_t command)
+{
+    published_state = command;
+    publish_calls++;
+}
+
+void change_wifi_mode(WiFiModeState_t wifi_mode, wifi_credentials_t *creds_opt)
+{
+    if (wifi_mode == AP_MODE)
+        ap_mode_requests++;
+}
+
+static uint32_t nvs_relay_state(void)
+{
+    uint32_t value = UINT32_MAX;
+    nvs_get_u32(1, "relay_state", &value);
+    return value;
+}
+
+static void press(uint8_t channel)
+{
+    mock_gpio_set_input(channel_pins[channel].button, 0);
+}
+
+static void release(uint8_t channel)
+{
+    mock_gpio_set_input(channel_pins[channel].button, 1);
+}
+
+static void test_boot_restore(void)
+{
+    CHECK(get_led_state() == SAVED_STATE);
+    CHECK(mock_relay_output.count == COUNT_BUTTONS && mock_relay_output.state == SAVED_STATE);
+
+    // Nothing held at boot: the first settle finds no click
+    mock_freertos_run_ms(100);
+    CHECK(publish_calls == 0);
+    CHECK(mock_freertos_blocked_forever(mock_freertos_find("vTaskButtonScan")));
+}
+
+static void check_command(LedCommandOp_t op, uint32_t mask, uint32_t expected)
+{
+    led_command_t cmd = {.mask = mask, .op = op};
+    uint32_t writes = mock_relay_output.writes;
+    uint32_t before = get_led_state();
+
+    uint32_t state = apply_led_command(&cmd);
+    CHECK_MSG(state == expected && get_led_state() == expected && mock_relay_output.state == expected,
+              "op %d mask 0x%" PRIx32 " from 0x%" PRIx32 ": got 0x%" PRIx32 ", relays 0x%" PRIx32
+              ", expected 0x%" PRIx32, op, mask, before, state, mock_relay_output.state, expected);
+    // The relays are only written on a change
+    CHECK_MSG(mock_relay_output.writes == writes + (expected != before),
+              "op %d mask 0x%" PRIx32 ": %" PRIu32 " relay writes", op, mask, mock_relay_output.writes - writes);
+}
+
+static void test_apply_commands(void)
+{
+    uint32_t saves = metrics_get(METRIC_RELAY_SAVES);
+
+    check_command(LED_CMD_ASSIGN, 0x5, 0x5);
+    check_command(LED_CMD_SET, 0x2, 0x7);
+    check_command(LED_CMD_SET, 0x2, 0x7);
+    check_command(LED_CMD_CLEAR, 0x5, 0x2);
+    check_command(LED_CMD_CLEAR, 0x5, 0x2);
+    check_command(LED_CMD_TOGGLE, 0x3, 0x1);
+    check_command(LED_CMD_TOGGLE, 0x3, 0x2);
+    check_command(LED_CMD_ASSIGN, 0x2, 0x2);
+    // Bits above the channel count never reach the relays
+    check_command(LED_CMD_ASSIGN, UINT32_MAX, LED_STATE_MASK);
+    check_command(LED_CMD_TOGGLE, ~LED_STATE_MASK | 0x1, LED_STATE_MASK & ~0x1);
+    check_command((LedCommandOp_t)7, 0x1, LED_STATE_MASK & ~0x1);
+    check_command(LED_CMD_ASSIGN, 0x4, 0x4);
+
+    // All of the above is one save window, armed by the first change
+    mock_freertos_run_ms(RELAY_STATE_SAVE_DELAY_MS - 100);
+    CHECK(mock_nvs.commits == 0 && metrics_get(METRIC_RELAY_SAVES) == saves);
+    mock_freertos_run_ms(200);
+    CHECK_MSG(mock_nvs.commits == 1 && mock_nvs.writes == 1, "%" PRIu32 " commits, %" PRIu32 " writes",
+              mock_nvs.commits, mock_nvs.writes);
+    CHECK(nvs_relay_state() == 0x4);
+    CHECK(metrics_get(METRIC_RELAY_SAVES) == saves + 1);
+
+    // Toggled back before the window closed: saved, but nothing new to write
+    check_command(LED_CMD_TOGGLE, 0x1, 0x5);
+    check_command(LED_CMD_TOGGLE, 0x1, 0x4);
+    mock_freertos_run_ms(RELAY_STATE_SAVE_DELAY_MS + 100);
+    CHECK(mock_nvs.writes == 1 && nvs_relay_state() == 0x4);
+    CHECK(metrics_get(METRIC_RELAY_SAVES) == saves + 2);
+}
+
+static void test_debounce(void)
+{
+    uint32_t clicks = metrics_get(METRIC_BUTTON_CLICKS);
+    uint32_t calls = publish_calls;
+    uint32_t start = get_led_state();
+
+    // Contact bounce: every edge restarts the debounce window
+    press(1);
+    mock_freertos_run_ms(5);
+    release(1);
+    mock_freertos_run_ms(5);
+    press(1);
+    mock_freertos_run_ms(BUTTON_DEBOUNCE_MS - 1);
+    CHECK_MSG(get_led_state() == start && publish_calls == calls, "toggled before the inputs settled");
+
+    mock_freertos_run_ms(2);
+    CHECK_MSG(get_led_state() == (start ^ 0x2), "state 0x%" PRIx32 " after the press settled", get_led_state());
+    CHECK(publish_calls == calls + 1 && published_state == (start ^ 0x2));
+    CHECK(metrics_get(METRIC_BUTTON_CLICKS) == clicks + 1);
+
+    // Bouncing release: no click
+    release(1);
+    mock_freertos_run_ms(3);
+    press(1);
+    mock_freertos_run_ms(3);
+    release(1);
+    mock_freertos_run_ms(BUTTON_DEBOUNCE_MS * 2);
+    CHECK(get_led_state() == (start ^ 0x2) && publish_calls == calls + 1);
+
+    // A glitch shorter than the window that ends released is not a click either
+    press(2);
+    mock_freertos_run_ms(BUTTON_DEBOUNCE_MS / 2);
+    release(2);
+    mock_freertos_run_ms(BUTTON_DEBOUNCE_MS * 2);
+    CHECK(get_led_state() == (start ^ 0x2) && publish_calls == calls + 1);
+
+    // Two buttons going down inside one window are one click on both channels
+    press(1);
+    mock_freertos_run_ms(10);
+    press(2);
+    mock_freertos_run_ms(BUTTON_DEBOUNCE_MS + 5);
+    CHECK_MSG(get_led_state() == (start ^ 0x4), "state 0x%" PRIx32 " after a two-button click", get_led_state());
+    CHECK(publish_calls == calls + 2 && published_state == (start ^ 0x4));
+    CHECK(metrics_get(METRIC_BUTTON_CLICKS) == clicks + 2);
+
+    // Releasing one while the other stays down changes nothing
+    release(2);
+    mock_freertos_run_ms(BUTTON_DEBOUNCE_MS * 2);
+    CHECK(publish_calls == calls + 2);
+    release(1);
+    mock_freertos_run_ms(BUTTON_DEBOUNCE_MS * 2);
+    CHECK(publish_calls == calls + 2);
+    CHECK(mock_freertos_blocked_forever(mock_freertos_find("vTaskButtonScan")));
+
+    mock_freertos_run_ms(RELAY_STATE_SAVE_DELAY_MS);
+    CHECK(nvs_relay_state() == get_led_state());
+}
+
+static void test_reset_hold(void)
+{
+    uint32_t start = get_led_state();
+
+    // Short hold: a click, then nothing once it is let go
+    press(0);
+    mock_freertos_run_ms(BUTTON_DEBOUNCE_MS + 5);
+    CHECK(get_led_state() == (start ^ 0x1));
+    mock_freertos_run_ms(2000);
+    release(0);
+    mock_freertos_run_ms(RESET_HOLD_MS);
+    CHECK(ap_mode_requests == 0);
+    CHECK(mock_freertos_blocked_forever(mock_freertos_find("vTaskButtonScan")));
+
+    // Long hold: AP mode RESET_HOLD_MS after the click, once
+    press(0);
+    mock_freertos_run_ms(BUTTON_DEBOUNCE_MS);
+    mock_freertos_run_ms(1);
+    CHECK(get_led_state() == start);
+    mock_freertos_run_ms(RESET_HOLD_MS - 20);
+    CHECK_MSG(ap_mode_requests == 0, "AP mode requested before the hold time");
+    mock_freertos_run_ms(40);
+    CHECK_MSG(ap_mode_requests == 1, "%" PRIu32 " AP mode requests after the hold time", ap_mode_requests);
+    mock_freertos_run_ms(RESET_HOLD_MS * 2);
+    CHECK(ap_mode_requests == 1);
+    // Waiting for the release only, without a timeout
+    CHECK(mock_freertos_blocked_forever(mock_freertos_find("vTaskButtonScan")));
+
+    release(0);
+    mock_freertos_run_ms(BUTTON_DEBOUNCE_MS * 2);
+    CHECK(get_led_state() == start && ap_mode_requests == 1);
+
+    // Holding another button does not count
+    press(1);
+    mock_freertos_run_ms(RESET_HOLD_MS * 2);
+    release(1);
+    mock_freertos_run_ms(BUTTON_DEBOUNCE_MS * 2);
+    CHECK(ap_mode_requests == 1);
+}
+
+int main(void)
+{
+    mock_gpio_reset();
+    mock_nvs_reset();
+    nvs_set_u32(1, "relay_state", SAVED_STATE);
+    mock_nvs.writes = 0;
+
+    // The part of app_main that control.c depends on
+    CHECK(storage_init() == ESP_OK);
+    gpio_init();
+    xTaskCreate(vTaskButtonScan, "vTaskButtonScan", 3072, NULL, 3, NULL);
+
+    test_boot_restore();
+    test_apply_commands();
+    test_debounce();
+    test_reset_hold();
+
+    return HOST_TEST_RESULT();
+}
@@ -0,0 +1,128 @@
+#include <string.h>
+#include <stdlib.h>
+#include "host_test.h"
+#include "dns_message.h"
+
+#define PORTAL_ADDR     0x0104A8C0      // 192.168.4.1 in network order on a little-endian host
+#define BUF_CAP         (512 + DNS_MAX_ANSWERS * DNS_ANSWER_SIZE)
+
+#define HDR(id, flags, qd, ar) (id) >> 8, (id) & 0xFF, (flags) >> 8, (flags) & 0xFF, \
+                               0, (qd), 0, 0, 0, 0, 0, (ar)
+#define Q_EXAMPLE   7, 'e', 'x', 'a', 'm', 'p', 'l', 'e', 3, 'c', 'o', 'm', 0
+#define QT(type)    0, (type), 0, 1
+
+typedef struct {
+    const char *name;
+    const uint8_t *query;
+    size_t len;
+    size_t cap;             // 0: BUF_CAP
+    size_t expect_len;      // 0: dropped
+    uint8_t expect_rcode;
+    uint8_t expect_ancount;
+} dns_case_t;
+
+static const uint8_t q_a[]          = {HDR(0x1234, 0x0100, 1, 0), Q_EXAMPLE, QT(1)};
+static const uint8_t q_aaaa[]       = {HDR(0x1234, 0x0100, 1, 0), Q_EXAMPLE, QT(28)};
+static const uint8_t q_any[]        = {HDR(0x0001, 0x0000, 1, 0), Q_EXAMPLE, QT(255)};
+static const uint8_t q_chaos[]      = {HDR(0x0001, 0x0100, 1, 0), Q_EXAMPLE, 0, 1, 0, 3};
+// Second question names example.com through a pointer to offset 12
+static const uint8_t q_compressed[] = {HDR(0x0002, 0x0100, 2, 0), Q_EXAMPLE, QT(1), 0xC0, 12, QT(1)};
+static const uint8_t q_five[]       = {HDR(0x0003, 0x0100, 5, 0), Q_EXAMPLE, QT(1), 0xC0, 12, QT(1),
+                                       0xC0, 12, QT(1), 0xC0, 12, QT(1), 0xC0, 12, QT(1)};
+// EDNS OPT record after the question is dropped from the response
+static const uint8_t q_edns[]       = {HDR(0x0004, 0x0100, 1, 1), Q_EXAMPLE, QT(1),
+                                       0, 0, 41, 0x10, 0, 0, 0, 0, 0, 0, 0};
+static const uint8_t q_iquery[]     = {HDR(0x0005, 0x0900, 1, 0), Q_EXAMPLE, QT(1)};
+static const uint8_t q_response[]   = {HDR(0x0006, 0x8180, 1, 0), Q_EXAMPLE, QT(1)};
+static const uint8_t q_short_hdr[]  = {0x12, 0x34, 0x01, 0x00, 0x00, 0x01, 0x00};
+static const uint8_t q_cut_name[]   = {HDR(0x0007, 0x0100, 1, 0), 7, 'e', 'x', 'a'};
+static const uint8_t q_cut_type[]   = {HDR(0x0008, 0x0100, 1, 0), Q_EXAMPLE, 0, 1, 0};
+static const uint8_t q_cut_ptr[]    = {HDR(0x0009, 0x0100, 1, 0), 0xC0};
+static const uint8_t q_bad_label[]  = {HDR(0x000A, 0x0100, 1, 0), 0x40, 'a', 0, QT(1)};
+static const uint8_t q_no_end[]     = {HDR(0x000B, 0x0100, 1, 0), 63, 'a', 'b', 'c'};
+static const uint8_t q_qd_overrun[] = {HDR(0x000C, 0x0100, 2, 0), Q_EXAMPLE, QT(1)};
+static const uint8_t q_empty[]      = {HDR(0x000D, 0x0100, 0, 0)};
+
+#define CASE(q, cap, len, rcode, an) {#q, q, sizeof(q), cap, len, rcode, an}
+
+static const dns_case_t cases[] = {
+    CASE(q_a,           0, sizeof(q_a) + DNS_ANSWER_SIZE, 0, 1),
+    CASE(q_aaaa,        0, sizeof(q_aaaa), 0, 0),
+    CASE(q_any,         0, sizeof(q_any) + DNS_ANSWER_SIZE, 0, 1),
+    CASE(q_chaos,       0, sizeof(q_chaos), 0, 0),
+    CASE(q_compressed,  0, sizeof(q_compressed) + 2 * DNS_ANSWER_SIZE, 0, 2),
+    CASE(q_five,        0, sizeof(q_five) + DNS_MAX_ANSWERS * DNS_ANSWER_SIZE, 0, DNS_MAX_ANSWERS),
+    CASE(q_edns,        0, sizeof(q_edns) - 11 + DNS_ANSWER_SIZE, 0, 1),
+    CASE(q_iquery,      0, sizeof(q_iquery), 4, 0),
+    CASE(q_empty,       0, DNS_HEADER_SIZE, 0, 0),
+    // Buffer with room for the question only, or for one answer out of two
+    CASE(q_a,           sizeof(q_a), sizeof(q_a), 0, 0),
+    CASE(q_compressed,  sizeof(q_compressed) + DNS_ANSWER_SIZE, sizeof(q_compressed) + DNS_ANSWER_SIZE, 0, 1),
+    CASE(q_response,    0, 0, 0, 0),
+    CASE(q_short_hdr,   0, 0, 0, 0),
+    CASE(q_cut_name,    0, 0, 0, 0),
+    CASE(q_cut_type,    0, 0, 0, 0),
+    CASE(q_cut_ptr,     0, 0, 0, 0),
+    CASE(q_bad_label,   0, 0, 0, 0),
+    CASE(q_no_end,      0, 0, 0, 0),
+    CASE(q_qd_overrun,  0, 0, 0, 0),
+};
+
+static void check_answer(const dns_case_t *c, const uint8_t *buf, size_t offset)
+{
+    static const uint8_t tail[] = {0, 1, 0, 1, 0, 0, 0, 60, 0, 4, 192, 168, 4, 1};
+
+    uint16_t ptr = ((buf[offset] & 0x3F) << 8) | buf[offset + 1];
+    CHECK_MSG((buf[offset] & 0xC0) == 0xC0 && ptr >= DNS_HEADER_SIZE && ptr < c->len,
+              "%s: answer at %zu does not point into the question section", c->name, offset);
+    CHECK_MSG(memcmp(&buf[offset + 2], tail, sizeof(tail)) == 0, "%s: bad answer record at %zu", c->name, offset);
+}
+
+static void run_case(const dns_case_t *c)
+{
+    size_t cap = c->cap ? c->cap : BUF_CAP;
+    // Exactly `cap` bytes on the heap so ASan flags any write past it
+    uint8_t *buf = malloc(cap);
+    memcpy(buf, c->query, c->len);
+
+    size_t len = dns_build_response(buf, c->len, cap);
+    CHECK_MSG(len == c->expect_len, "%s: length %zu, expected %zu", c->name, len, c->expect_len);
+    if (len == 0 || len != c->expect_len)
+    {
+        free(buf);
+        return;
+    }
+
+    CHECK_MSG(buf[0] == c->query[0] && buf[1] == c->query[1], "%s: ID changed", c->name);
+    CHECK_MSG((buf[2] & 0x84) == 0x84, "%s: QR/AA not set", c->name);
+    CHECK_MSG((buf[2] & 0x79) == (c->query[2] & 0x79), "%s: opcode/RD not kept", c->name);
+    CHECK_MSG((buf[3] & 0x0F) == c->expect_rcode, "%s: rcode %d, expected %d", c->name, buf[3] & 0x0F, c->expect_rcode);
+    CHECK_MSG(buf[4] == c->query[4] && buf[5] == c->query[5], "%s: QDCOUNT changed", c->name);
+    CHECK_MSG(buf[6] == 0 && buf[7] == c->expect_ancount, "%s: ANCOUNT %d, expected %d", c->name, buf[7], c->expect_ancount);
+    CHECK_MSG(!buf[8] && !buf[9] && !buf[10] && !buf[11], "%s: NSCOUNT/ARCOUNT not cleared", c->name);
+
+    size_t answers = len - c->expect_ancount * DNS_ANSWER_SIZE;
+    for (uint8_t i = 0; i < c->expect_ancount; i++)
+        check_answer(c, buf, answers + i * DNS_ANSWER_SIZE);
+    free(buf);
+}
+
+int main(void)
+{
+    dns_message_init(PORTAL_ADDR);
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+        run_case(&cases[i]);
+
+    // Every prefix of a valid query is either dropped or answered within the buffer
+    for (size_t len = 0; len < sizeof(q_five); len++)
+    {
+        uint8_t *buf = malloc(BUF_CAP);
+        memcpy(buf, q_five, len);
+        size_t out = dns_build_response(buf, len, BUF_CAP);
+        CHECK_MSG(out == 0 || (len >= DNS_HEADER_SIZE && out <= BUF_CAP), "prefix %zu: length %zu", len, out);
+        free(buf);
+    }
+
+    return HOST_TEST_RESULT();
+}
@@ -0,0 +1,129 @@
+#include <inttypes.h>
+#include "host_test.h"
+#include "mock_freertos.h"
+#include "mock_gpio.h"
+#include "mock_nvs.h"
+#include "mock_mqtt_client.h"
+#include "control.h"
+#include "mqtt.h"
+#include "latency_bench.h"
+
+// vTaskLatencyBench on the simulated scheduler, built with LATENCY_BENCH=1:
+// the same synthetic events, stage marks and p50/p99/p999 report as on the
+// device. Stage timestamps come from the virtual clock and a cost model, so
+// the figures show queueing and preemption, not the CPU cost of parsing or
+// building JSON; those only come from a run on the board.
+
+// Rough ESP32-C3 figures at 160 MHz
+#define SWITCH_COST_US      8
+#define PUBLISH_COST_US     120     // esp-mqtt outbox and lwIP send
+// Wi-Fi and lwIP work above every application task, woken each tick
+#define NET_TASK_PRIORITY   18
+
+static uint32_t rng_state = 0x2545F491;
+
+// Only reachable through the reset button, which is not held here
+void change_wifi_mode(WiFiModeState_t wifi_mode, wifi_credentials_t *creds_opt)
+{
+}
+
+static uint32_t rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+// Mostly short bursts, now and then a long one (a scan, a retransmit storm)
+static void net_load_task(void *pvParameter)
+{
+    while (1)
+    {
+        vTaskDelay(1);
+        uint32_t r = rng();
+        mock_freertos_busy_us(r % 100 < 2 ? 2000 + r % 2000 : r % 300);
+    }
+}
+
+// Known samples through the histogram: uniform 1..1000 us
+static void check_percentiles(void)
+{
+    bench_stage_stats_t stats;
+
+    mock_clock_us = 1;
+    for (uint32_t us = 1; us <= 1000; us++)
+    {
+        latency_bench_start(BENCH_PATH_COMMAND);
+        mock_clock_us += us;
+        latency_bench_mark(BENCH_STAGE_CMD_DEQUEUED);
+    }
+    latency_bench_stats(BENCH_STAGE_CMD_DEQUEUED, &stats);
+
+    // Reported as bucket upper bounds: never below the exact value, at most 1/8 above
+    CHECK_MSG(stats.count == 1000 && stats.max_us == 1000, "count %" PRIu32 " max %" PRIu32,
+              stats.count, stats.max_us);
+    CHECK_MSG(stats.p50_us >= 500 && stats.p50_us <= 500 + 500 / 8, "p50 %" PRIu32, stats.p50_us);
+    CHECK_MSG(stats.p99_us >= 990 && stats.p99_us <= 990 + 990 / 8, "p99 %" PRIu32, stats.p99_us);
+    CHECK_MSG(stats.p999_us >= 999 && stats.p999_us <= 999 + 999 / 8, "p999 %" PRIu32, stats.p999_us);
+}
+
+static void check_report(void)
+{
+    bench_stage_stats_t stats, prev = {0};
+
+    for (uint8_t s = 0; s < BENCH_STAGE_COUNT; s++)
+    {
+        latency_bench_stats(s, &stats);
+        CHECK_MSG(stats.count == LATENCY_BENCH_EVENTS, "stage %d: %" PRIu32 " samples", s, stats.count);
+        // The top bucket's upper bound may lie above the largest sample
+        CHECK_MSG(stats.p50_us <= stats.p99_us && stats.p99_us <= stats.p999_us &&
+                  stats.p999_us <= stats.max_us + stats.max_us / 8, "stage %d: percentiles out of order", s);
+        // Stages are timed from the start of their path, later ones cannot be sooner
+        if (s != BENCH_STAGE_BTN_APPLIED && s != BENCH_STAGE_CMD_PARSED)
+            CHECK_MSG(stats.p50_us >= prev.p50_us, "stage %d: p50 below the stage before", s);
+        prev = stats;
+    }
+
+    latency_bench_stats(BENCH_STAGE_CMD_APPLIED, &stats);
+    CHECK(stats.p50_us >= SWITCH_COST_US);
+    latency_bench_stats(BENCH_STAGE_PUB_SENT, &stats);
+    CHECK(stats.p50_us >= PUBLISH_COST_US);
+    // Publishes the network task preempted make up the tail
+    CHECK(stats.max_us > stats.p50_us);
+}
+
+int main(void)
+{
+    mock_gpio_reset();
+    mock_nvs_reset();
+
+    // Before vTaskLatencyBench starts, it clears the histograms
+    check_percentiles();
+
+    CHECK(storage_init() == ESP_OK);
+    gpio_init();
+    mqtt_config_load();
+    xTaskCreate(vTaskButtonScan, "vTaskButtonScan", 3072, NULL, 3, NULL);
+    xTaskCreate(vTaskParseFromMqtt, "vTaskParseFromMqtt", 4096, NULL, 6, NULL);
+    xTaskCreate(vTaskMqttPublish, "vTaskMqttPublish", 4096, NULL, 6, NULL);
+    xTaskCreate(vTaskLatencyBench, "vTaskLatencyBench", 4096, NULL, 2, NULL);
+    xTaskCreate(net_load_task, "net_load", 2048, NULL, NET_TASK_PRIORITY, NULL);
+
+    mqtt_app_start();
+    mock_freertos_run_ms(10);
+    mock_mqtt_connect();
+    mock_freertos_run_ms(10);
+    CHECK(mock_mqtt.connected);
+
+    mock_switch_cost_us = SWITCH_COST_US;
+    mock_mqtt.publish_cost_us = PUBLISH_COST_US;
+
+    // 10 s settle time, then both paths; the task deletes itself when done
+    for (int s = 0; s < 120 && mock_freertos_find("vTaskLatencyBench"); s++)
+        mock_freertos_run_ms(1000);
+    CHECK_MSG(mock_freertos_find("vTaskLatencyBench") == NULL, "benchmark did not finish");
+
+    check_report();
+    return HOST_TEST_RESULT();
+}
@@ -0,0 +1,238 @@
+#include <inttypes.h>
+#include <string.h>
+#include "host_test.h"
+#include "mock_freertos.h"
+#include "mock_gpio.h"
+#include "mock_nvs.h"
+#include "mock_relay_output.h"
+#include "mock_mqtt_client.h"
+#include "mock_log_stream.h"
+#include "control.h"
+#include "mqtt.h"
+
+// mqtt.c, parse.c and control.c on the simulated scheduler, against the fake
+// esp-mqtt client: topic -> parse -> queue -> apply -> state publish, with the
+// firmware's own tasks at their app_main priorities.
+
+#define TOPIC_DEVICE    MQTT_DEFAULT_BASE_TOPIC "/" MQTT_DEFAULT_DEVICE_ID
+#define TOPIC_CMD       TOPIC_DEVICE MQTT_TOPIC_SUB_SUFFIX
+#define TOPIC_STATE     TOPIC_DEVICE MQTT_TOPIC_PUB_SUFFIX
+#define TOPIC_AVAIL     TOPIC_DEVICE MQTT_TOPIC_AVAIL_SUFFIX
+#define TOPIC_LOG_LEVEL TOPIC_DEVICE MQTT_TOPIC_LOG_LEVEL_SUFFIX
+#define TOPIC_CH(n)     TOPIC_DEVICE MQTT_TOPIC_CH_INFIX #n MQTT_TOPIC_CH_SUFFIX
+
+// Only reachable through the reset button, which is not held here
+void change_wifi_mode(WiFiModeState_t wifi_mode, wifi_credentials_t *creds_opt)
+{
+}
+
+static void expected_state_json(uint32_t state, char *out, size_t size)
+{
+    size_t len = snprintf(out, size, "{\"states\":[");
+    for (uint8_t i = 0; i < COUNT_BUTTONS; i++)
+        len += snprintf(out + len, size - len, "%s\"%s\"", i ? "," : "", (state & (1UL << i)) ? "ON" : "OFF");
+    snprintf(out + len, size - len, "]}");
+}
+
+// The relays hold `state` and exactly that was published as the retained state
+static void check_state(const char *what, uint32_t state)
+{
+    char expected[128];
+    const mock_mqtt_publish_t *publish = mock_mqtt_last_publish(TOPIC_STATE);
+
+    expected_state_json(state, expected, sizeof(expected));
+    CHECK_MSG(get_led_state() == state && mock_relay_output.state == state,
+              "%s: state 0x%" PRIx32 ", relays 0x%" PRIx32 ", expected 0x%" PRIx32,
+              what, get_led_state(), mock_relay_output.state, state);
+    CHECK_MSG(publish && strcmp(publish->data, expected) == 0 && publish->qos == 1 && publish->retain == 1,
+              "%s: published '%s', expected '%s'", what, publish ? publish->data : "(nothing)", expected);
+}
+
+static void deliver(const char *topic, const char *payload, size_t chunk)
+{
+    mock_mqtt_clear_log();
+    mock_mqtt_deliver(topic, payload, chunk);
+    mock_freertos_run_ms(10);
+}
+
+// Delivered but must leave the relays alone and publish nothing
+static void check_ignored(const char *topic, const char *payload, MetricCounter_t counter)
+{
+    uint32_t state = get_led_state();
+    uint32_t writes = mock_relay_output.writes;
+    uint32_t count = metrics_get(counter);
+
+    deliver(topic, payload, 0);
+    CHECK_MSG(get_led_state() == state && mock_relay_output.writes == writes && mock_mqtt.publish_count == 0,
+              "'%s' on %s changed the state", payload, topic);
+    CHECK_MSG(metrics_get(counter) == count + 1, "'%s' on %s not counted", payload, topic);
+}
+
+static void test_connect(void)
+{
+    mqtt_app_start();
+    mock_freertos_run_ms(10);
+    CHECK(mock_mqtt.started && !mock_mqtt.connected);
+    CHECK(mock_log_stream.sink != NULL);
+
+    mock_mqtt_connect();
+    mock_freertos_run_ms(10);
+    CHECK(mock_mqtt.subscribe_count == 3);
+    CHECK(strcmp(mock_mqtt.subscriptions[0], TOPIC_CMD) == 0);
+    CHECK(strcmp(mock_mqtt.subscriptions[1], TOPIC_DEVICE MQTT_TOPIC_CH_INFIX "+" MQTT_TOPIC_CH_SUFFIX) == 0);
+    CHECK(strcmp(mock_mqtt.subscriptions[2], TOPIC_LOG_LEVEL) == 0);
+
+    const mock_mqtt_publish_t *avail = mock_mqtt_last_publish(TOPIC_AVAIL);
+    CHECK(avail && strcmp(avail->data, MQTT_AVAIL_ONLINE) == 0 && avail->retain == 1);
+    // The current state goes out on every connect
+    check_state("connect", 0);
+    CHECK(metrics_get(METRIC_MQTT_PUBLISHES) == 1);
+}
+
+static void test_commands(void)
+{
+    uint32_t cmds = metrics_get(METRIC_MQTT_CMDS);
+
+    deliver(TOPIC_CH(1), "{\"state\":\"ON\"}", 0);
+    check_state("ch 1 ON", 0x2);
+    deliver(TOPIC_CMD, "{\"states\":[\"ON\",\"OFF\",\"ON\"]}", 0);
+    check_state("device states", 0x5);
+    deliver(TOPIC_CH(0), "{\"state\":\"TOGGLE\"}", 0);
+    check_state("ch 0 TOGGLE", 0x4);
+    deliver(TOPIC_CH(2), "{\"state\":\"OFF\"}", 0);
+    check_state("ch 2 OFF", 0x0);
+    deliver(TOPIC_CMD, "{\"state\":\"ON\"}", 0);
+    check_state("device ON", LED_STATE_MASK);
+
+    // Reassembled from chunks; only the first one carries the topic
+    deliver(TOPIC_CMD, "{\"note\":\"split over several events\",\"states\":[\"OFF\",\"ON\",\"OFF\"]}", 5);
+    check_state("chunked", 0x2);
+    deliver(TOPIC_CH(0), "{\"state\":\"ON\"}", 1);
+    check_state("one byte chunks", 0x3);
+
+    CHECK(metrics_get(METRIC_MQTT_CMDS) == cmds + 7);
+}
+
+static void test_rejected(void)
+{
+    check_ignored(TOPIC_CH(0), "{\"state\":\"MAYBE\"}", METRIC_MQTT_PARSE_ERRORS);
+    check_ignored(TOPIC_CH(0), "{\"state\":tru}", METRIC_MQTT_PARSE_ERRORS);
+    // "states" addresses the whole device, a channel topic does not take it
+    check_ignored(TOPIC_CH(1), "{\"states\":[\"OFF\",\"OFF\",\"OFF\"]}", METRIC_MQTT_PARSE_ERRORS);
+    check_ignored(TOPIC_CMD, "{\"states\":[\"OFF\",\"OFF\"", METRIC_MQTT_PARSE_ERRORS);
+
+    // Unknown topics never reach the parser
+    uint32_t cmds = metrics_get(METRIC_MQTT_CMDS);
+    uint32_t errors = metrics_get(METRIC_MQTT_PARSE_ERRORS);
+    uint32_t state = get_led_state();
+    deliver(TOPIC_DEVICE MQTT_TOPIC_CH_INFIX "3" MQTT_TOPIC_CH_SUFFIX, "{\"state\":\"ON\"}", 0);
+    deliver(TOPIC_DEVICE MQTT_TOPIC_CH_INFIX "x" MQTT_TOPIC_CH_SUFFIX, "{\"state\":\"ON\"}", 0);
+    deliver(TOPIC_DEVICE MQTT_TOPIC_CH_INFIX MQTT_TOPIC_CH_SUFFIX, "{\"state\":\"ON\"}", 0);
+    deliver(TOPIC_DEVICE "/other", "{\"state\":\"ON\"}", 0);
+    CHECK(get_led_state() == state && mock_mqtt.publish_count == 0);
+    CHECK(metrics_get(METRIC_MQTT_CMDS) == cmds && metrics_get(METRIC_MQTT_PARSE_ERRORS) == errors);
+
+    // Over the reassembly limit: dropped before any chunk is kept
+    char big[MQTT_CMD_REASM_MAX_LEN + 64];
+    memset(big, ' ', sizeof(big) - 1);
+    big[sizeof(big) - 1] = '\0';
+    memcpy(big, "{\"state\":\"ON\"}", strlen("{\"state\":\"ON\"}"));
+    uint32_t drops = metrics_get(METRIC_MQTT_CMD_DROPS);
+    deliver(TOPIC_CH(2), big, 100);
+    CHECK(get_led_state() == state && metrics_get(METRIC_MQTT_CMD_DROPS) == drops + 1);
+}
+
+static void test_log_level(void)
+{
+    deliver(TOPIC_LOG_LEVEL, "MQTT_SENSOR=debug", 0);
+    CHECK(mock_log_stream.settings_applied == 1);
+    CHECK(strcmp(mock_log_stream.setting, "MQTT_SENSOR=debug") == 0);
+    CHECK(mock_mqtt.publish_count == 0);
+}
+
+static void test_button_publish(void)
+{
+    uint32_t state = get_led_state();
+
+    mock_mqtt_clear_log();
+    mock_gpio_set_input(channel_pins[2].button, 0);
+    mock_freertos_run_ms(BUTTON_DEBOUNCE_MS + 5);
+    check_state("button click", state ^ 0x4);
+    mock_gpio_set_input(channel_pins[2].button, 1);
+    mock_freertos_run_ms(BUTTON_DEBOUNCE_MS + 5);
+}
+
+static void test_offline(void)
+{
+    uint32_t publishes = metrics_get(METRIC_MQTT_PUBLISHES);
+    uint32_t fails = metrics_get(METRIC_MQTT_PUBLISH_FAILS);
+    led_command_t cmd = {.mask = 0x1, .op = LED_CMD_TOGGLE};
+
+    // Refused by the client while connected: counted as a failure only
+    mock_mqtt.refuse_publish = true;
+    deliver(TOPIC_CH(0), "{\"state\":\"TOGGLE\"}", 0);
+    mock_mqtt.refuse_publish = false;
+    CHECK(mock_mqtt.publish_count == 0);
+    CHECK(metrics_get(METRIC_MQTT_PUBLISHES) == publishes);
+    CHECK(metrics_get(METRIC_MQTT_PUBLISH_FAILS) == fails + 1);
+
+    // Offline: not even attempted
+    mock_mqtt_disconnect();
+    mock_freertos_run_ms(10);
+    CHECK(!mock_mqtt.connected);
+    mock_mqtt_clear_log();
+    apply_led_command(&cmd);
+    mqtt_send_to_publish(get_led_state());
+    mock_freertos_run_ms(10);
+    CHECK(mock_mqtt.publish_count == 0);
+    CHECK(metrics_get(METRIC_MQTT_PUBLISH_FAILS) == fails + 1);
+
+    // The state changed while offline is published on reconnect
+    mock_mqtt_connect();
+    mock_freertos_run_ms(10);
+    check_state("reconnect", get_led_state());
+    CHECK(metrics_get(METRIC_MQTT_PUBLISHES) == publishes + 1);
+}
+
+static void test_stop(void)
+{
+    mock_mqtt_clear_log();
+    mqtt_app_stop();
+    const mock_mqtt_publish_t *avail = mock_mqtt_last_publish(TOPIC_AVAIL);
+    CHECK(avail && strcmp(avail->data, MQTT_AVAIL_OFFLINE) == 0);
+    CHECK(!mock_mqtt.started && mock_log_stream.sink == NULL);
+    CHECK(mock_freertos_find("mqtt_task") == NULL);
+
+    // Relay changes keep working without a client
+    mock_mqtt_clear_log();
+    led_command_t cmd = {.mask = 0x1, .op = LED_CMD_TOGGLE};
+    uint32_t state = apply_led_command(&cmd);
+    mqtt_send_to_publish(state);
+    mock_freertos_run_ms(10);
+    CHECK(mock_relay_output.state == state && mock_mqtt.publish_count == 0);
+}
+
+int main(void)
+{
+    mock_gpio_reset();
+    mock_nvs_reset();
+
+    // app_main without Wi-Fi; mqtt_app_start() is what the Wi-Fi manager calls once online
+    CHECK(storage_init() == ESP_OK);
+    gpio_init();
+    mqtt_config_load();
+    xTaskCreate(vTaskButtonScan, "vTaskButtonScan", 3072, NULL, 3, NULL);
+    xTaskCreate(vTaskParseFromMqtt, "vTaskParseFromMqtt", 4096, NULL, 6, NULL);
+    xTaskCreate(vTaskMqttPublish, "vTaskMqttPublish", 4096, NULL, 6, NULL);
+    mock_freertos_run_ms(10);
+
+    test_connect();
+    test_commands();
+    test_rejected();
+    test_log_level();
+    test_button_publish();
+    test_offline();
+    test_stop();
+
+    return HOST_TEST_RESULT();
+}
@@ -0,0 +1,127 @@
+#include <string.h>
+#include "host_test.h"
+#include "parse.h"
+
+// Built with COUNT_BUTTONS=3: LED_STATE_MASK is 0x7, channel n is bit n
+
+#define ANY_MASK    0xFFu   // marks a case that must fail, the mask is not checked
+
+typedef struct {
+    const char *json;
+    uint32_t target_mask;
+    esp_err_t expect_err;
+    uint8_t expect_op;
+    uint32_t expect_mask;
+} parse_case_t;
+
+static const parse_case_t cases[] = {
+    // Whole-device array, one entry per channel
+    {"{\"states\":[\"ON\",\"OFF\",\"ON\"]}",            LED_STATE_MASK, ESP_OK, LED_CMD_ASSIGN, 0x5},
+    {"{\"states\":[]}",                                 LED_STATE_MASK, ESP_OK, LED_CMD_ASSIGN, 0x0},
+    {" { \"states\" : [ \"ON\" , \"ON\" ] } ",          LED_STATE_MASK, ESP_OK, LED_CMD_ASSIGN, 0x3},
+    {"{\"states\":[\"on\",\"OFF\",\"TOGGLE\"]}",        LED_STATE_MASK, ESP_OK, LED_CMD_ASSIGN, 0x0},
+    // Entries past the last channel are ignored, non-strings count as OFF
+    {"{\"states\":[\"ON\",\"ON\",\"ON\",\"ON\",\"ON\"]}", LED_STATE_MASK, ESP_OK, LED_CMD_ASSIGN, 0x7},
+    {"{\"states\":[1,null,{\"a\":[true]},\"ON\"]}",     LED_STATE_MASK, ESP_OK, LED_CMD_ASSIGN, 0x0},
+    {"{\"states\":[\"OFF\",[\"ON\"],\"ON\"]}",          LED_STATE_MASK, ESP_OK, LED_CMD_ASSIGN, 0x4},
+
+    // Single state: device topic addresses every channel, channel topics one bit
+    {"{\"state\":\"ON\"}",                              LED_STATE_MASK, ESP_OK, LED_CMD_SET,    LED_STATE_MASK},
+    {"{\"state\":\"OFF\"}",                             0x2,            ESP_OK, LED_CMD_CLEAR,  0x2},
+    {"{\"state\":\"TOGGLE\"}",                          0x4,            ESP_OK, LED_CMD_TOGGLE, 0x4},
+    {"{\"state\":\"on\"}",                              0x1,            ESP_FAIL, 0, ANY_MASK},
+    {"{\"state\":\"ONN\"}",                             0x1,            ESP_FAIL, 0, ANY_MASK},
+    {"{\"state\":1}",                                   0x1,            ESP_FAIL, 0, ANY_MASK},
+    {"{\"state\":[\"ON\"]}",                            0x1,            ESP_FAIL, 0, ANY_MASK},
+
+    // "states" is only honoured on the device topic
+    {"{\"states\":[\"ON\",\"ON\",\"ON\"]}",             0x1,            ESP_FAIL, 0, ANY_MASK},
+    {"{\"states\":[\"ON\"],\"state\":\"OFF\"}",         0x1,            ESP_OK, LED_CMD_CLEAR,  0x1},
+    {"{\"states\":\"ON\"}",                             LED_STATE_MASK, ESP_FAIL, 0, ANY_MASK},
+
+    // Unknown keys are skipped whatever their value, the first known key wins
+    {"{\"brightness\":255,\"state\":\"ON\"}",           0x1,            ESP_OK, LED_CMD_SET,    0x1},
+    {"{\"x\":{\"y\":[1,2,{\"z\":\"}\"}]},\"state\":\"OFF\",\"q\":-1.5E3}", 0x2, ESP_OK, LED_CMD_CLEAR, 0x2},
+    {"{\"k\\\"ey\":\"va\\\"l\",\"state\":\"TOGGLE\"}",  0x1,            ESP_OK, LED_CMD_TOGGLE, 0x1},
+    {"{\"state\":\"ON\",\"state\":\"OFF\"}",            0x1,            ESP_OK, LED_CMD_SET,    0x1},
+    {"{\"state\":\"OFF\",\"states\":[\"ON\"]}",         LED_STATE_MASK, ESP_OK, LED_CMD_CLEAR,  LED_STATE_MASK},
+    {"{\"other\":true}",                                LED_STATE_MASK, ESP_FAIL, 0, ANY_MASK},
+    {"{}",                                              LED_STATE_MASK, ESP_FAIL, 0, ANY_MASK},
+
+    // Malformed
+    {"",                                                LED_STATE_MASK, ESP_FAIL, 0, ANY_MASK},
+    {"ON",                                              LED_STATE_MASK, ESP_FAIL, 0, ANY_MASK},
+    {"[\"ON\"]",                                        LED_STATE_MASK, ESP_FAIL, 0, ANY_MASK},
+    {"{\"state\":\"ON\"",                               0x1,            ESP_FAIL, 0, ANY_MASK},
+    {"{\"state\":\"ON}",                                0x1,            ESP_FAIL, 0, ANY_MASK},
+    {"{\"state\" \"ON\"}",                              0x1,            ESP_FAIL, 0, ANY_MASK},
+    {"{state:\"ON\"}",                                  0x1,            ESP_FAIL, 0, ANY_MASK},
+    {"{\"state\":\"ON\",}",                             0x1,            ESP_FAIL, 0, ANY_MASK},
+    {"{\"states\":[\"ON\",]}",                          LED_STATE_MASK, ESP_FAIL, 0, ANY_MASK},
+    {"{\"states\":[\"ON\"}",                            LED_STATE_MASK, ESP_FAIL, 0, ANY_MASK},
+    {"{\"x\":\"a\nb\",\"state\":\"ON\"}",               0x1,            ESP_FAIL, 0, ANY_MASK},
+    {"{\"x\":\"\\",                                     0x1,            ESP_FAIL, 0, ANY_MASK},
+    // Skipped values must still be valid JSON: exact keywords, numbers per the JSON grammar
+    {"{\"x\":abc,\"state\":\"ON\"}",                 LED_STATE_MASK, ESP_FAIL, 0, ANY_MASK},
+    {"{\"states\":[\"ON\",bogus]}",                   LED_STATE_MASK, ESP_FAIL, 0, ANY_MASK},
+    {"{\"x\":tru,\"state\":\"ON\"}",                 0x1,            ESP_FAIL, 0, ANY_MASK},
+    {"{\"x\":truex,\"state\":\"ON\"}",               0x1,            ESP_FAIL, 0, ANY_MASK},
+    {"{\"x\":nul,\"state\":\"ON\"}",                 0x1,            ESP_FAIL, 0, ANY_MASK},
+    {"{\"x\":True,\"state\":\"ON\"}",                0x1,            ESP_FAIL, 0, ANY_MASK},
+    {"{\"x\":-,\"state\":\"ON\"}",                   0x1,            ESP_FAIL, 0, ANY_MASK},
+    {"{\"x\":+1,\"state\":\"ON\"}",                  0x1,            ESP_FAIL, 0, ANY_MASK},
+    {"{\"x\":01,\"state\":\"ON\"}",                  0x1,            ESP_FAIL, 0, ANY_MASK},
+    {"{\"x\":.5,\"state\":\"ON\"}",                  0x1,            ESP_FAIL, 0, ANY_MASK},
+    {"{\"x\":1.,\"state\":\"ON\"}",                  0x1,            ESP_FAIL, 0, ANY_MASK},
+    {"{\"x\":1e,\"state\":\"ON\"}",                  0x1,            ESP_FAIL, 0, ANY_MASK},
+    {"{\"x\":1e+,\"state\":\"ON\"}",                 0x1,            ESP_FAIL, 0, ANY_MASK},
+    {"{\"x\":1-2,\"state\":\"ON\"}",                 0x1,            ESP_FAIL, 0, ANY_MASK},
+    {"{\"x\":0x10,\"state\":\"ON\"}",                0x1,            ESP_FAIL, 0, ANY_MASK},
+    {"{\"x\":[true,false,null,0,-0,10,-1.25,2e10,3E-2,4.5e+1],\"state\":\"ON\"}", 0x1, ESP_OK, LED_CMD_SET, 0x1},
+    {"{\"states\":[false,\"ON\",\"ON\"]}",           LED_STATE_MASK, ESP_OK, LED_CMD_ASSIGN, 0x6},
+    {"{\"state\":\"ON\",\"x\":null}",                0x1,            ESP_OK, LED_CMD_SET,    0x1},
+    // Nesting deeper than JSON_MAX_DEPTH is refused rather than recursed into
+    {"{\"x\":[[[[[[[[[[1]]]]]]]]]],\"state\":\"ON\"}",  0x1,            ESP_FAIL, 0, ANY_MASK},
+    {"{\"x\":[[[[[[1]]]]]],\"state\":\"ON\"}",          0x1,            ESP_OK, LED_CMD_SET,    0x1},
+};
+
+static void run_case(size_t index, const parse_case_t *c)
+{
+    led_command_t cmd = {.mask = 0xDEAD, .op = 0xEE};
+    esp_err_t err = parse_mqtt_command_json(c->json, strlen(c->json), c->target_mask, &cmd);
+
+    CHECK_MSG(err == c->expect_err, "case %zu '%s': err %d, expected %d", index, c->json, err, c->expect_err);
+    if (c->expect_err != ESP_OK)
+    {
+        CHECK_MSG(cmd.mask == 0xDEAD && cmd.op == 0xEE, "case %zu '%s': output written on failure", index, c->json);
+        return;
+    }
+    CHECK_MSG(cmd.op == c->expect_op && cmd.mask == c->expect_mask,
+              "case %zu '%s': op %d mask 0x%x, expected op %d mask 0x%x",
+              index, c->json, cmd.op, (unsigned)cmd.mask, c->expect_op, (unsigned)c->expect_mask);
+}
+
+int main(void)
+{
+    led_command_t cmd;
+    const char *json = "{\"state\":\"ON\"}";
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+        run_case(i, &cases[i]);
+
+    // Target masks outside the channel range are refused before parsing
+    CHECK(parse_mqtt_command_json(json, strlen(json), 0, &cmd) == ESP_ERR_INVALID_ARG);
+    CHECK(parse_mqtt_command_json(json, strlen(json), 1u << COUNT_BUTTONS, &cmd) == ESP_ERR_INVALID_ARG);
+    CHECK(parse_mqtt_command_json(json, strlen(json), LED_STATE_MASK | 0x80000000u, &cmd) == ESP_ERR_INVALID_ARG);
+    CHECK(parse_mqtt_command_json(NULL, 0, 0x1, &cmd) == ESP_ERR_INVALID_ARG);
+    CHECK(parse_mqtt_command_json(json, strlen(json), 0x1, NULL) == ESP_ERR_INVALID_ARG);
+
+    // The payload is not NUL-terminated on the wire: only data_len bytes may be read
+    char exact[sizeof("{\"state\":\"OFF\"}") - 1];
+    memcpy(exact, "{\"state\":\"OFF\"}", sizeof(exact));
+    CHECK(parse_mqtt_command_json(exact, sizeof(exact), 0x2, &cmd) == ESP_OK && cmd.op == LED_CMD_CLEAR);
+    for (size_t len = 0; len < sizeof(exact); len++)
+        CHECK_MSG(parse_mqtt_command_json(exact, len, 0x2, &cmd) == ESP_FAIL, "prefix %zu accepted", len);
+
+    return HOST_TEST_RESULT();
+}
@@ -0,0 +1,79 @@
+#include "host_test.h"
+#include "mock_gpio.h"
+#include "relay_output.h"
+#include "shearch_component.h"
+
+// Built per channel count. Channel i drives relay_pins[i]; the first three are
+// the firmware's channel_pins relays, pin 7 is the indicator LED and must never
+// be touched by a relay write.
+
+#define INDICATOR_PIN   GPIO_NUM_7
+
+static const gpio_num_t relay_pins[] = {
+    GPIO_NUM_8, GPIO_NUM_9, GPIO_NUM_10, GPIO_NUM_1, GPIO_NUM_2, GPIO_NUM_3,
+    GPIO_NUM_4, GPIO_NUM_5, GPIO_NUM_6, GPIO_NUM_18, GPIO_NUM_19, GPIO_NUM_20,
+};
+
+_Static_assert(COUNT_BUTTONS <= sizeof(relay_pins) / sizeof(relay_pins[0]), "not enough distinct relay pins");
+
+static uint32_t expected_pins(uint32_t state, uint8_t count)
+{
+    uint32_t pins = 0;
+    for (uint8_t i = 0; i < count; i++)
+    {
+        if (state & (1UL << i))
+            pins |= (1UL << relay_pins[i]);
+    }
+    return pins;
+}
+
+// Every state, in counting order so each write also starts from a different
+// previous state; both registers are written once and the indicator is kept
+static void check_all_states(uint8_t count)
+{
+    uint32_t all = expected_pins(LED_STATE_MASK, count);
+
+    mock_gpio_reset();
+    mock_gpio.out = (1UL << INDICATOR_PIN);
+    relay_output_init(relay_pins, count);
+    CHECK_MSG(mock_gpio.out == (1UL << INDICATOR_PIN), "N=%d count=%d: init left out=0x%08x",
+              COUNT_BUTTONS, count, (unsigned)mock_gpio.out);
+
+    for (uint32_t state = 0; state <= LED_STATE_MASK; state++)
+    {
+        uint32_t want = expected_pins(state, count);
+
+        mock_gpio.w1ts_writes = mock_gpio.w1tc_writes = 0;
+        relay_output_write(state);
+
+        CHECK_MSG(mock_gpio.w1ts_writes == 1 && mock_gpio.w1tc_writes == 1 && mock_gpio.other_writes == 0,
+                  "N=%d count=%d state=0x%x: %u W1TS, %u W1TC, %u other writes", COUNT_BUTTONS, count,
+                  (unsigned)state, (unsigned)mock_gpio.w1ts_writes, (unsigned)mock_gpio.w1tc_writes,
+                  (unsigned)mock_gpio.other_writes);
+        CHECK_MSG(mock_gpio.last_w1ts == want && mock_gpio.last_w1tc == (all & ~want),
+                  "N=%d count=%d state=0x%x: W1TS 0x%08x W1TC 0x%08x, expected 0x%08x 0x%08x",
+                  COUNT_BUTTONS, count, (unsigned)state, (unsigned)mock_gpio.last_w1ts,
+                  (unsigned)mock_gpio.last_w1tc, (unsigned)want, (unsigned)(all & ~want));
+        CHECK_MSG(mock_gpio.out == (want | (1UL << INDICATOR_PIN)),
+                  "N=%d count=%d state=0x%x: out 0x%08x", COUNT_BUTTONS, count, (unsigned)state,
+                  (unsigned)mock_gpio.out);
+    }
+}
+
+int main(void)
+{
+    check_all_states(COUNT_BUTTONS);
+
+    // Fewer pins than channels: the channels without a pin drive nothing
+    if (COUNT_BUTTONS > 1)
+        check_all_states(COUNT_BUTTONS - 1);
+
+    // Bits above the channel count are ignored
+    mock_gpio_reset();
+    relay_output_init(relay_pins, COUNT_BUTTONS);
+    relay_output_write(~LED_STATE_MASK);
+    CHECK(mock_gpio.out == 0);
+    CHECK(mock_gpio.last_w1ts == 0);
+
+    return HOST_TEST_RESULT();
+}
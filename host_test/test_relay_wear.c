@@ -0,0 +1,181 @@
+#include <inttypes.h>
+#include <string.h>
+#include "host_test.h"
+#include "mock_freertos.h"
+#include "mock_gpio.h"
+#include "mock_nvs.h"
+#include "control.h"
+
+// Flash wear of the relay state journal against the NVS page model: page
+// erases per 10^6 toggles when every toggle is written, as before the save
+// window, and with control.c coalescing writes over RELAY_STATE_SAVE_DELAY_MS.
+// The coalesced run goes through apply_led_command() and the real save timer
+// and task on the simulated clock.
+
+#define TOGGLES                 1000000
+// Typical NOR flash sector endurance
+#define FLASH_ERASE_CYCLES      100000
+
+typedef struct {
+    const char *name;
+    uint32_t (*next_gap_ms)(void);
+} toggle_trace_t;
+
+typedef struct {
+    uint32_t writes;
+    uint32_t erases;
+    uint32_t worst_page;
+} wear_t;
+
+static uint32_t rng_state;
+
+void mqtt_send_to_publish(uint32_t command)
+{
+}
+
+void change_wifi_mode(WiFiModeState_t wifi_mode, wifi_credentials_t *creds_opt)
+{
+}
+
+static uint32_t rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+// Someone at the wall switch: a few quick corrections, most toggles minutes apart
+static uint32_t gap_household(void)
+{
+    uint32_t r = rng() % 100;
+    if (r < 30)
+        return 300 + rng() % 2700;
+    if (r < 60)
+        return 3000 + rng() % 57000;
+    return 60000 + rng() % (59 * 60000);
+}
+
+// An automation or a misbehaving client flapping channels a few times a second
+static uint32_t gap_flapping(void)
+{
+    return 100 + rng() % 400;
+}
+
+static const toggle_trace_t traces[] = {
+    {"household", gap_household},
+    {"flapping", gap_flapping},
+};
+
+// The configuration a provisioned device keeps next to the relay state; its
+// live entries are what every page reclaim has to move
+static void nvs_format_provisioned(void)
+{
+    static const uint8_t sta_fast[64] = {0};
+
+    mock_nvs_reset();
+    nvs_set_str(1, "ssid", "home-network");
+    nvs_set_str(1, "pass", "correct horse battery staple");
+    nvs_set_str(1, "mqtt_uri", "mqtt://192.168.0.102:1883");
+    nvs_set_str(1, "mqtt_base", "home/rooms/living/lights");
+    nvs_set_str(1, "mqtt_id", "id1");
+    nvs_set_blob(1, "sta_fast", sta_fast, sizeof(sta_fast));
+    nvs_set_u32(1, "relay_state", get_led_state());
+    memset(&mock_nvs, 0, sizeof(mock_nvs));
+}
+
+static wear_t wear_taken(void)
+{
+    return (wear_t){
+        .writes = mock_nvs.writes,
+        .erases = mock_nvs.page_erases,
+        .worst_page = mock_nvs_max_page_erases(),
+    };
+}
+
+static void check_config_intact(const char *what)
+{
+    char ssid[64];
+    size_t len = sizeof(ssid);
+    CHECK_MSG(nvs_get_str(1, "ssid", ssid, &len) == ESP_OK && strcmp(ssid, "home-network") == 0,
+              "%s: configuration lost across page reclaims", what);
+}
+
+// Before the save window: one NVS write and commit per toggle
+static wear_t run_write_through(const toggle_trace_t *trace)
+{
+    uint32_t state = get_led_state();
+
+    nvs_format_provisioned();
+    rng_state = 0x9E3779B9;
+    for (uint32_t i = 0; i < TOGGLES; i++)
+    {
+        state ^= 1UL << (rng() % COUNT_BUTTONS);
+        trace->next_gap_ms();
+        storage_set_u32(STORAGE_KEY_RELAY_STATE, state);
+        storage_commit();
+    }
+    CHECK(mock_nvs.writes == TOGGLES);
+    check_config_intact(trace->name);
+    return wear_taken();
+}
+
+// Now: toggles go through control.c, the save timer coalesces them
+static wear_t run_coalesced(const toggle_trace_t *trace)
+{
+    led_command_t cmd = {.op = LED_CMD_TOGGLE};
+
+    nvs_format_provisioned();
+    rng_state = 0x9E3779B9;
+    for (uint32_t i = 0; i < TOGGLES; i++)
+    {
+        cmd.mask = 1UL << (rng() % COUNT_BUTTONS);
+        uint32_t gap_ms = trace->next_gap_ms();
+        apply_led_command(&cmd);
+        mock_freertos_run_ms(gap_ms);
+    }
+    mock_freertos_run_ms(RELAY_STATE_SAVE_DELAY_MS);
+
+    uint32_t saved = UINT32_MAX;
+    CHECK(nvs_get_u32(1, "relay_state", &saved) == ESP_OK && saved == get_led_state());
+    check_config_intact(trace->name);
+    return wear_taken();
+}
+
+static void print_row(const char *trace, const char *saves, const wear_t *wear)
+{
+    char lifetime[32] = "-";
+    if (wear->worst_page)
+    {
+        snprintf(lifetime, sizeof(lifetime), "%.3g", (double)FLASH_ERASE_CYCLES * TOGGLES / wear->worst_page);
+    }
+    printf("%-10s %-14s %10" PRIu32 " %10" PRIu32 " %10" PRIu32 " %16s\n",
+           trace, saves, wear->writes, wear->erases, wear->worst_page, lifetime);
+}
+
+int main(void)
+{
+    mock_gpio_reset();
+    mock_nvs_reset();
+    CHECK(storage_init() == ESP_OK);
+    gpio_init();
+
+    printf("NVS: %d pages of %d entries, per %d toggles\n", MOCK_NVS_PAGES, MOCK_NVS_PAGE_ENTRIES, TOGGLES);
+    printf("%-10s %-14s %10s %10s %10s %16s\n", "trace", "saves", "writes", "erases", "worst page", "toggles to wear");
+
+    for (size_t t = 0; t < sizeof(traces) / sizeof(traces[0]); t++)
+    {
+        wear_t before = run_write_through(&traces[t]);
+        wear_t after = run_coalesced(&traces[t]);
+
+        print_row(traces[t].name, "every toggle", &before);
+        print_row(traces[t].name, "coalesced 5 s", &after);
+
+        CHECK_MSG(before.erases > 0, "%s: write-through never filled the partition", traces[t].name);
+        CHECK_MSG(after.writes < before.writes && after.erases < before.erases,
+                  "%s: coalescing saved nothing (%" PRIu32 " vs %" PRIu32 " erases)",
+                  traces[t].name, after.erases, before.erases);
+    }
+
+    return HOST_TEST_RESULT();
+}
@@ -0,0 +1,87 @@
+#include <string.h>
+#include "host_test.h"
+#include "parse.h"
+
+#define JSON_BUF_LEN    512
+
+// The formatter build_mqtt_state_json() replaced: cJSON_PrintUnformatted() of
+// {"states": [...]} with one "ON"/"OFF" string per channel, bit i = channel i
+static size_t reference_state_json(char *buf, size_t size, uint32_t state)
+{
+    size_t len = snprintf(buf, size, "{\"states\":[");
+    for (uint8_t i = 0; i < COUNT_BUTTONS; i++)
+    {
+        len += snprintf(&buf[len], size - len, "%s\"%s\"", i ? "," : "", (state & (1UL << i)) ? "ON" : "OFF");
+    }
+    len += snprintf(&buf[len], size - len, "]}");
+    return len;
+}
+
+static void check_state(uint32_t state)
+{
+    char expected[JSON_BUF_LEN];
+    char actual[JSON_BUF_LEN];
+    size_t expected_len = reference_state_json(expected, sizeof(expected), state);
+    size_t actual_len = 0;
+
+    memset(actual, 0x5a, sizeof(actual));
+    esp_err_t err = build_mqtt_state_json(actual, sizeof(actual), state, &actual_len);
+    CHECK_MSG(err == ESP_OK, "N=%d state=0x%08x: err %d", COUNT_BUTTONS, (unsigned)state, err);
+    if (err != ESP_OK)
+        return;
+
+    CHECK_MSG(actual_len == expected_len && strlen(actual) == actual_len && strcmp(actual, expected) == 0,
+              "N=%d state=0x%08x:\n  got      %s\n  expected %s", COUNT_BUTTONS, (unsigned)state, actual, expected);
+
+    // Like the old formatter: the string and its terminator must fit, one byte less is refused
+    memset(actual, 0, sizeof(actual));
+    CHECK(build_mqtt_state_json(actual, expected_len + 1, state, NULL) == ESP_OK);
+    CHECK(strcmp(actual, expected) == 0);
+    CHECK(build_mqtt_state_json(actual, expected_len, state, NULL) == ESP_ERR_NO_MEM);
+}
+
+int main(void)
+{
+    char buf[JSON_BUF_LEN];
+
+    CHECK(build_mqtt_state_json(buf, sizeof(buf), 0, NULL) == ESP_ERR_INVALID_STATE);
+    parse_init();
+    CHECK(build_mqtt_state_json(NULL, sizeof(buf), 0, NULL) == ESP_ERR_INVALID_ARG);
+    CHECK(build_mqtt_state_json(buf, 0, 0, NULL) == ESP_ERR_INVALID_ARG);
+
+    if (COUNT_BUTTONS <= 12)
+    {
+        for (uint32_t state = 0; state <= LED_STATE_MASK; state++)
+            check_state(state);
+    }
+    else
+    {
+        check_state(0);
+        check_state(LED_STATE_MASK);
+        check_state(0x55555555 & LED_STATE_MASK);
+        check_state(0xAAAAAAAA & LED_STATE_MASK);
+        for (uint8_t i = 0; i < COUNT_BUTTONS; i++)
+        {
+            check_state(1UL << i);
+            check_state(LED_STATE_MASK & ~(1UL << i));
+        }
+        uint32_t seed = 12345;
+        for (int i = 0; i < 4096; i++)
+        {
+            seed = seed * 1664525 + 1013904223;
+            check_state(seed & LED_STATE_MASK);
+        }
+    }
+
+    // Bits above the channel count do not show up in the payload
+    if (COUNT_BUTTONS < 32)
+    {
+        char expected[JSON_BUF_LEN];
+        size_t len = 0;
+        reference_state_json(expected, sizeof(expected), 1);
+        CHECK(build_mqtt_state_json(buf, sizeof(buf), 1 | ~LED_STATE_MASK, &len) == ESP_OK);
+        CHECK(strcmp(buf, expected) == 0);
+    }
+
+    return HOST_TEST_RESULT();
+}
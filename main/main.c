@@ -2,21 +2,42 @@
 #include "mqtt.h"
 #include "control.h"
 #include "storage_manager.h"
+#include "latency_bench.h"
+#include "metrics.h"
+#include "log_stream.h"
 
 
 void app_main(void)
 {
-    gpio_init();
+    TaskHandle_t task;
+
+    // From here on log calls only copy into RAM, the drain task does the UART
+    log_stream_init();
+    xTaskCreate(vTaskLogStreamDrain, "vTaskLogStreamDrain", 3072, NULL, 2, &task);
+    metrics_watch_task(task);
+
     storage_init();
+    gpio_init();
+    mqtt_config_load();
 
     wifi_init();
     launch_wifi_saved_mode();
 
-    xTaskCreate(vTaskIndicateState, "vTaskIndicateState", 2048, NULL, 1, NULL);
-    xTaskCreate(vTaskButtonScan, "vTaskButtonScan", 3072, NULL, 3, NULL);
+    xTaskCreate(vTaskButtonScan, "vTaskButtonScan", 3072, NULL, 3, &task);
+    metrics_watch_task(task);
+
+    xTaskCreate(vTaskStartStaWifiConnect, "start_sta_wifi_connect_task", 4096, NULL, 5, &task);
+    metrics_watch_task(task);
+
+    xTaskCreate(vTaskParseFromMqtt, "vTaskParseFromMqtt", 4096, NULL, 6, &task);
+    metrics_watch_task(task);
+    xTaskCreate(vTaskMqttPublish, "vTaskMqttPublish", 4096, NULL, 6, &task);
+    metrics_watch_task(task);
 
-    xTaskCreate(vTaskStartStaWifiConnect, "start_sta_wifi_connect_task", 4096, NULL, 5, NULL);
+    xTaskCreate(vTaskMqttMetrics, "vTaskMqttMetrics", 3072, NULL, 1, &task);
+    metrics_watch_task(task);
 
-    xTaskCreate(vTaskParseFromMqtt, "vTaskParseFromMqtt", 4096, NULL, 6, NULL);
-    xTaskCreate(vTaskMqttPublish, "vTaskMqttPublish", 4096, NULL, 6, NULL);
+#if LATENCY_BENCH
+    xTaskCreate(vTaskLatencyBench, "vTaskLatencyBench", 4096, NULL, 2, NULL);
+#endif
 }